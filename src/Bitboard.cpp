@@ -0,0 +1,365 @@
+#include "Bitboard.h"
+#include "Seat.h"
+
+namespace BitboardSpace {
+
+// Zobrist键值表：以splitmix64序列在编译期生成，棋子编码（0-15）× 位置，另加走棋方
+struct ZobristTable {
+    uint64_t pieceKeys[16][SEATNUM];
+    uint64_t sideKey;
+};
+
+constexpr uint64_t splitMix64(uint64_t& state)
+{
+    uint64_t z{ state += 0x9E3779B97F4A7C15ULL };
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristTable makeZobristTable()
+{
+    ZobristTable table{};
+    uint64_t state{ 0x58514348455353ULL };
+    for (auto& keys : table.pieceKeys)
+        for (auto& key : keys)
+            key = splitMix64(state);
+    table.sideKey = splitMix64(state);
+    return table;
+}
+
+constexpr ZobristTable zobristTable{ makeZobristTable() };
+
+// 掩码表：程序首次使用时由SeatManager的走法表一次生成
+struct MaskTables {
+    Bitboard rays[4][SEATNUM], files[BOARDCOLNUM];
+    Bitboard kingMoves[2][SEATNUM], advisorMoves[2][SEATNUM], pawnMoves[2][SEATNUM];
+    int knightLegs[SEATNUM][4];
+    Bitboard knightLegMoves[SEATNUM][4];
+    int bishopEyes[2][SEATNUM][4], bishopEyeMoves[2][SEATNUM][4];
+    // 反向表：可攻击某位置的马（按马腿分组）、兵的位置
+    int knightAttackLegs[SEATNUM][4];
+    Bitboard knightAttackFroms[SEATNUM][4], pawnAttackFroms[2][SEATNUM];
+
+    MaskTables()
+    {
+        for (auto& legs : knightAttackLegs)
+            fill(begin(legs), end(legs), -1);
+        auto __getBitboard = [](const RowCol_pair& rowcol_pair) {
+            return Bitboard::fromIndex(BitboardManager::getIndex(rowcol_pair.first, rowcol_pair.second));
+        };
+        for (int index = 0; index != SEATNUM; ++index) {
+            RowCol_pair rowcol_pair{ BitboardManager::getRow(index), BitboardManager::getCol(index) };
+            files[rowcol_pair.second] |= Bitboard::fromIndex(index);
+            int dir{ 0 };
+            for (auto& rowcol_Line : SeatManager::getRookCannonMoveRowCol_Lines(rowcol_pair)) { // 左右下上
+                for (auto& rowcol : rowcol_Line)
+                    rays[dir][index] |= __getBitboard(rowcol);
+                ++dir;
+            }
+
+            // 同一马腿对应两个目标位置
+            fill(begin(knightLegs[index]), end(knightLegs[index]), -1);
+            for (auto& obs_Moverowcol : SeatManager::getKnightObs_MoveRowCols(true, rowcol_pair)) {
+                int leg{ BitboardManager::getIndex(obs_Moverowcol.first.first, obs_Moverowcol.first.second) }, legNo{ 0 };
+                while (knightLegs[index][legNo] != -1 && knightLegs[index][legNo] != leg)
+                    ++legNo;
+                knightLegs[index][legNo] = leg;
+                knightLegMoves[index][legNo] |= __getBitboard(obs_Moverowcol.second);
+
+                int tindex{ BitboardManager::getIndex(obs_Moverowcol.second.first, obs_Moverowcol.second.second) }, attackLegNo{ 0 };
+                while (knightAttackLegs[tindex][attackLegNo] != -1 && knightAttackLegs[tindex][attackLegNo] != leg)
+                    ++attackLegNo;
+                knightAttackLegs[tindex][attackLegNo] = leg;
+                knightAttackFroms[tindex][attackLegNo] |= Bitboard::fromIndex(index);
+            }
+
+            for (int isBottom = 0; isBottom != 2; ++isBottom) {
+                for (auto& rowcol : SeatManager::getKingMoveRowCols(isBottom, rowcol_pair))
+                    kingMoves[isBottom][index] |= __getBitboard(rowcol);
+                for (auto& rowcol : SeatManager::getAdvisorMoveRowCols(isBottom, rowcol_pair))
+                    advisorMoves[isBottom][index] |= __getBitboard(rowcol);
+                for (auto& rowcol : SeatManager::getPawnMoveRowCols(isBottom, rowcol_pair)) {
+                    pawnMoves[isBottom][index] |= __getBitboard(rowcol);
+                    pawnAttackFroms[isBottom][BitboardManager::getIndex(rowcol.first, rowcol.second)] |= Bitboard::fromIndex(index);
+                }
+
+                fill(begin(bishopEyes[isBottom][index]), end(bishopEyes[isBottom][index]), -1);
+                int eyeNo{ 0 };
+                for (auto& obs_Moverowcol : SeatManager::getBishopObs_MoveRowCols(isBottom, rowcol_pair)) {
+                    bishopEyes[isBottom][index][eyeNo] = BitboardManager::getIndex(obs_Moverowcol.first.first, obs_Moverowcol.first.second);
+                    bishopEyeMoves[isBottom][index][eyeNo++] = BitboardManager::getIndex(obs_Moverowcol.second.first, obs_Moverowcol.second.second);
+                }
+            }
+        }
+    }
+};
+
+static const MaskTables& getMaskTables()
+{
+    static const MaskTables maskTables{};
+    return maskTables;
+}
+
+/* ===== Bitboards start. ===== */
+void Bitboards::clear()
+{
+    *this = Bitboards{};
+}
+
+void Bitboards::togglePiece(int index, Piece piece)
+{
+    Bitboard bb{ Bitboard::fromIndex(index) };
+    pieces_[static_cast<int>(piece.color())][static_cast<int>(piece.kind())] ^= bb;
+    colorPieces_[static_cast<int>(piece.color())] ^= bb;
+    occupied_ ^= bb;
+    hashKey_ ^= zobristTable.pieceKeys[piece.code()][index];
+}
+
+Bitboard Bitboards::getMoves(PieceColor bottomColor, int index, Piece piece) const
+{
+    bool isBottom{ bottomColor == piece.color() };
+    Bitboard moves{};
+    switch (piece.kind()) {
+    case PieceKind::ROOK:
+        moves = __getRookMoves(index);
+        break;
+    case PieceKind::CANNON:
+        moves = __getCannonMoves(index);
+        break;
+    case PieceKind::KNIGHT:
+        moves = __getKnightMoves(index);
+        break;
+    case PieceKind::BISHOP:
+        moves = __getBishopMoves(isBottom, index);
+        break;
+    case PieceKind::PAWN:
+        moves = BitboardManager::getPawnMoves(isBottom, index);
+        break;
+    case PieceKind::ADVISOR:
+        moves = BitboardManager::getAdvisorMoves(isBottom, index);
+        break;
+    case PieceKind::KING:
+        moves = BitboardManager::getKingMoves(isBottom, index);
+        break;
+    default:
+        break;
+    }
+    return moves & ~getPieces(piece.color());
+}
+
+Bitboard Bitboards::getStrongePieces(PieceColor color) const
+{
+    return getPieces(color) ^ getPieces(color, PieceKind::KING)
+        ^ getPieces(color, PieceKind::ADVISOR) ^ getPieces(color, PieceKind::BISHOP);
+}
+
+Piece Bitboards::getPiece(int index) const
+{
+    for (auto color : { PieceColor::RED, PieceColor::BLACK })
+        if (getPieces(color).test(index))
+            for (int kind = 0; kind != 7; ++kind)
+                if (pieces_[static_cast<int>(color)][kind].test(index))
+                    return Piece{ color, static_cast<PieceKind>(kind) };
+    return Piece{};
+}
+
+Bitboard Bitboards::getAttackers(PieceColor bottomColor, int index, PieceColor color) const
+{
+    // 由该位置向四方查找：首个棋子为车（纵向为将帅则对面），次个棋子为炮
+    Bitboard attackers{}, rooks{ getPieces(color, PieceKind::ROOK) }, cannons{ getPieces(color, PieceKind::CANNON) },
+        king{ getPieces(color, PieceKind::KING) };
+    for (int dir = 0; dir != 4; ++dir) {
+        bool isInc{ BitboardManager::isIncDirection(dir) };
+        Bitboard blocks{ BitboardManager::getRay(dir, index) & occupied_ };
+        if (blocks.none())
+            continue;
+        int first{ isInc ? blocks.lsb() : blocks.msb() };
+        Bitboard firstBB{ Bitboard::fromIndex(first) };
+        attackers |= firstBB & rooks;
+        if (dir == BitboardManager::DOWN || dir == BitboardManager::UP)
+            attackers |= firstBB & king;
+        if ((blocks &= BitboardManager::getRay(dir, first)))
+            attackers |= Bitboard::fromIndex(isInc ? blocks.lsb() : blocks.msb()) & cannons;
+    }
+
+    // 马腿在该位置的斜向相邻位置
+    Bitboard knights{ getPieces(color, PieceKind::KNIGHT) };
+    for (int legNo = 0; legNo != 4; ++legNo) {
+        int leg{ BitboardManager::getKnightAttackLeg(index, legNo) };
+        if (leg >= 0 && !occupied_.test(leg))
+            attackers |= BitboardManager::getKnightAttackFroms(index, legNo) & knights;
+    }
+
+    return attackers | (BitboardManager::getPawnAttackFroms(bottomColor == color, index) & getPieces(color, PieceKind::PAWN));
+}
+
+bool Bitboards::isKilled(PieceColor bottomColor, PieceColor color) const
+{
+    return isAttacked(bottomColor, __getKingIndex(color), PieceManager::getOtherColor(color));
+}
+
+KingSafety Bitboards::getKingSafety(PieceColor bottomColor, PieceColor color) const
+{
+    PieceColor otherColor{ PieceManager::getOtherColor(color) };
+    KingSafety safety{};
+    safety.kingIndex = __getKingIndex(color);
+    safety.checkers = getAttackers(bottomColor, safety.kingIndex, otherColor);
+    if (safety.checkers) // 被将军时全部走法均需试走
+        return safety;
+
+    Bitboard own{ getPieces(color) }, rooks{ getPieces(otherColor, PieceKind::ROOK) },
+        cannons{ getPieces(otherColor, PieceKind::CANNON) }, king{ getPieces(otherColor, PieceKind::KING) };
+    for (int dir = 0; dir != 4; ++dir) {
+        // 由将帅向外的前三个棋子
+        bool isInc{ BitboardManager::isIncDirection(dir) };
+        Bitboard ray{ BitboardManager::getRay(dir, safety.kingIndex) }, blocks{ ray & occupied_ };
+        int block[3], count{ 0 };
+        for (; blocks && count != 3; ++count) {
+            block[count] = isInc ? blocks.lsb() : blocks.msb();
+            blocks &= BitboardManager::getRay(dir, block[count]);
+        }
+        if (count == 0)
+            continue;
+
+        Bitboard firstBB{ Bitboard::fromIndex(block[0]) };
+        if (firstBB & cannons) // 对方炮之前的空位，走入即成炮架
+            safety.screens |= ray ^ BitboardManager::getRay(dir, block[0]) ^ firstBB;
+        if (count > 1 && (firstBB & own)) {
+            Bitboard secondBB{ Bitboard::fromIndex(block[1]) };
+            if ((secondBB & rooks) || ((dir == BitboardManager::DOWN || dir == BitboardManager::UP) && (secondBB & king)))
+                safety.pinned |= firstBB;
+        }
+        if (count > 2 && (Bitboard::fromIndex(block[2]) & cannons)) // 两个炮架之一走开即被将军
+            safety.pinned |= (firstBB | Bitboard::fromIndex(block[1])) & own;
+    }
+
+    Bitboard knights{ getPieces(otherColor, PieceKind::KNIGHT) };
+    for (int legNo = 0; legNo != 4; ++legNo) {
+        int leg{ BitboardManager::getKnightAttackLeg(safety.kingIndex, legNo) };
+        if (leg >= 0 && own.test(leg) && (BitboardManager::getKnightAttackFroms(safety.kingIndex, legNo) & knights))
+            safety.pinned |= Bitboard::fromIndex(leg);
+    }
+    return safety;
+}
+
+Bitboard Bitboards::getLegalMoves(PieceColor bottomColor, int index, Piece piece, const KingSafety& safety) const
+{
+    Bitboard moves{ getMoves(bottomColor, index, piece) };
+    if (safety.checkers.none() && index != safety.kingIndex && !safety.pinned.test(index))
+        return moves & ~safety.screens;
+
+    Bitboard legalMoves{};
+    for (Bitboard bb{ moves }; bb;) {
+        int tindex{ bb.popLsb() };
+        if (__isLegalMove(bottomColor, index, tindex, piece))
+            legalMoves |= Bitboard::fromIndex(tindex);
+    }
+    return legalMoves;
+}
+
+int Bitboards::__getKingIndex(PieceColor color) const
+{
+    Bitboard kingBB{ getPieces(color, PieceKind::KING) };
+    if (kingBB.none())
+        throw runtime_error("将（帅）不在棋盘上面!");
+    return kingBB.lsb();
+}
+
+bool Bitboards::__isLegalMove(PieceColor bottomColor, int findex, int tindex, Piece piece) const
+{
+    // 在副本上试走，检测是否会被对方将军
+    Bitboards bitboards{ *this };
+    Piece eatPiece{ getPiece(tindex) };
+    if (eatPiece)
+        bitboards.togglePiece(tindex, eatPiece);
+    bitboards.togglePiece(findex, piece);
+    bitboards.togglePiece(tindex, piece);
+    return !bitboards.isKilled(bottomColor, piece.color());
+}
+
+Bitboard Bitboards::__getRookMoves(int index) const
+{
+    Bitboard moves{};
+    for (int dir = 0; dir != 4; ++dir) {
+        Bitboard ray{ BitboardManager::getRay(dir, index) }, blocks{ ray & occupied_ };
+        if (blocks) // 到首个棋子为止（含该棋子）
+            ray ^= BitboardManager::getRay(dir, BitboardManager::isIncDirection(dir) ? blocks.lsb() : blocks.msb());
+        moves |= ray;
+    }
+    return moves;
+}
+
+Bitboard Bitboards::__getCannonMoves(int index) const
+{
+    Bitboard moves{};
+    for (int dir = 0; dir != 4; ++dir) {
+        bool isInc{ BitboardManager::isIncDirection(dir) };
+        Bitboard ray{ BitboardManager::getRay(dir, index) }, blocks{ ray & occupied_ };
+        if (blocks.none()) {
+            moves |= ray;
+            continue;
+        }
+        // 炮架之前的空位，及炮架之后的首个棋子
+        int screen{ isInc ? blocks.lsb() : blocks.msb() };
+        Bitboard behind{ BitboardManager::getRay(dir, screen) };
+        moves |= ray ^ behind ^ Bitboard::fromIndex(screen);
+        if ((blocks &= behind))
+            moves |= Bitboard::fromIndex(isInc ? blocks.lsb() : blocks.msb());
+    }
+    return moves;
+}
+
+Bitboard Bitboards::__getKnightMoves(int index) const
+{
+    Bitboard moves{};
+    for (int legNo = 0; legNo != 4; ++legNo) {
+        int leg{ BitboardManager::getKnightLeg(index, legNo) };
+        if (leg >= 0 && !occupied_.test(leg)) // 马腿无棋子
+            moves |= BitboardManager::getKnightLegMoves(index, legNo);
+    }
+    return moves;
+}
+
+Bitboard Bitboards::__getBishopMoves(bool isBottom, int index) const
+{
+    Bitboard moves{};
+    for (int eyeNo = 0; eyeNo != 4; ++eyeNo) {
+        int eye{ BitboardManager::getBishopEye(isBottom, index, eyeNo) };
+        if (eye >= 0 && !occupied_.test(eye)) // 象眼无棋子
+            moves |= Bitboard::fromIndex(BitboardManager::getBishopEyeMove(isBottom, index, eyeNo));
+    }
+    return moves;
+}
+/* ===== Bitboards end. ===== */
+
+/* ===== BitboardManager start. ===== */
+Bitboard BitboardManager::getRay(int dir, int index) { return getMaskTables().rays[dir][index]; }
+
+Bitboard BitboardManager::getFile(int col) { return getMaskTables().files[col]; }
+
+Bitboard BitboardManager::getKingMoves(bool isBottom, int index) { return getMaskTables().kingMoves[isBottom][index]; }
+
+Bitboard BitboardManager::getAdvisorMoves(bool isBottom, int index) { return getMaskTables().advisorMoves[isBottom][index]; }
+
+Bitboard BitboardManager::getPawnMoves(bool isBottom, int index) { return getMaskTables().pawnMoves[isBottom][index]; }
+
+int BitboardManager::getKnightLeg(int index, int legNo) { return getMaskTables().knightLegs[index][legNo]; }
+
+Bitboard BitboardManager::getKnightLegMoves(int index, int legNo) { return getMaskTables().knightLegMoves[index][legNo]; }
+
+int BitboardManager::getBishopEye(bool isBottom, int index, int eyeNo) { return getMaskTables().bishopEyes[isBottom][index][eyeNo]; }
+
+int BitboardManager::getBishopEyeMove(bool isBottom, int index, int eyeNo) { return getMaskTables().bishopEyeMoves[isBottom][index][eyeNo]; }
+
+int BitboardManager::getKnightAttackLeg(int index, int legNo) { return getMaskTables().knightAttackLegs[index][legNo]; }
+
+Bitboard BitboardManager::getKnightAttackFroms(int index, int legNo) { return getMaskTables().knightAttackFroms[index][legNo]; }
+
+Bitboard BitboardManager::getPawnAttackFroms(bool isBottom, int index) { return getMaskTables().pawnAttackFroms[isBottom][index]; }
+
+uint64_t BitboardManager::getZobristKey(Piece piece, int index) { return zobristTable.pieceKeys[piece.code()][index]; }
+
+uint64_t BitboardManager::getZobristSideKey() { return zobristTable.sideKey; }
+/* ===== BitboardManager end. ===== */
+}
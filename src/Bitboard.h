@@ -0,0 +1,169 @@
+﻿#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "ChessType.h"
+#include "Piece.h"
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace BitboardSpace {
+
+// 64位整数的置位数、最低及最高置位序号（后两者参数不能为0）；MSVC无GCC的内建函数
+#ifdef _MSC_VER
+inline int popCount64(uint64_t x) { return static_cast<int>(__popcnt64(x)); }
+inline int lsb64(uint64_t x)
+{
+    unsigned long index{};
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+}
+inline int msb64(uint64_t x)
+{
+    unsigned long index{};
+    _BitScanReverse64(&index, x);
+    return static_cast<int>(index);
+}
+#else
+inline int popCount64(uint64_t x) { return __builtin_popcountll(x); }
+inline int lsb64(uint64_t x) { return __builtin_ctzll(x); }
+inline int msb64(uint64_t x) { return 63 - __builtin_clzll(x); }
+#endif
+
+// 90位棋盘位集：低64位、高26位，位序号 = 行 * 9 + 列
+class Bitboard {
+public:
+    constexpr Bitboard()
+        : low_{ 0 }
+        , high_{ 0 }
+    {
+    }
+    constexpr Bitboard(uint64_t low, uint64_t high)
+        : low_{ low }
+        , high_{ high & HighMask_ }
+    {
+    }
+
+    static Bitboard fromIndex(int index) { return index < 64 ? Bitboard{ 1ULL << index, 0 } : Bitboard{ 0, 1ULL << (index - 64) }; }
+
+    bool any() const { return low_ || high_; }
+    bool none() const { return !any(); }
+    explicit operator bool() const { return any(); }
+    int count() const { return popCount64(low_) + popCount64(high_); }
+    bool test(int index) const { return index < 64 ? (low_ >> index) & 1 : (high_ >> (index - 64)) & 1; }
+
+    // 最低、最高位的序号（位集不能为空）
+    int lsb() const { return low_ ? lsb64(low_) : 64 + lsb64(high_); }
+    int msb() const { return high_ ? 64 + msb64(high_) : msb64(low_); }
+    int popLsb()
+    {
+        int index{ lsb() };
+        index < 64 ? low_ &= low_ - 1 : high_ &= high_ - 1;
+        return index;
+    }
+    int popMsb()
+    {
+        int index{ msb() };
+        *this ^= fromIndex(index);
+        return index;
+    }
+
+    Bitboard operator&(const Bitboard& bb) const { return Bitboard{ low_ & bb.low_, high_ & bb.high_ }; }
+    Bitboard operator|(const Bitboard& bb) const { return Bitboard{ low_ | bb.low_, high_ | bb.high_ }; }
+    Bitboard operator^(const Bitboard& bb) const { return Bitboard{ low_ ^ bb.low_, high_ ^ bb.high_ }; }
+    Bitboard operator~() const { return Bitboard{ ~low_, ~high_ }; }
+    Bitboard& operator&=(const Bitboard& bb) { return *this = *this & bb; }
+    Bitboard& operator|=(const Bitboard& bb) { return *this = *this | bb; }
+    Bitboard& operator^=(const Bitboard& bb) { return *this = *this ^ bb; }
+    bool operator==(const Bitboard& bb) const { return low_ == bb.low_ && high_ == bb.high_; }
+    bool operator!=(const Bitboard& bb) const { return !(*this == bb); }
+
+private:
+    static constexpr uint64_t HighMask_{ (1ULL << (SEATNUM - 64)) - 1 };
+
+    uint64_t low_, high_;
+};
+
+// 某方将帅的安全信息：每个局面计算一次，据此判断走法是否需要试走检验
+struct KingSafety {
+    int kingIndex;
+    Bitboard checkers; // 正在将军的对方棋子
+    Bitboard pinned; // 走动后可能被将军的本方棋子（车、炮、马腿牵制及将帅对面）
+    Bitboard screens; // 走入即成为对方炮架的空位
+};
+
+// 按颜色、种类分别记录棋子占位的位棋盘，以掩码计算走法
+class Bitboards {
+public:
+    void clear();
+    // 在某位置放置或移除棋子（异或翻转），同时更新Zobrist键值
+    void togglePiece(int index, Piece piece);
+    uint64_t getHashKey() const { return hashKey_; }
+
+    Bitboard getOccupied() const { return occupied_; }
+    Bitboard getPieces(PieceColor color) const { return colorPieces_[static_cast<int>(color)]; }
+    Bitboard getPieces(PieceColor color, PieceKind kind) const { return pieces_[static_cast<int>(color)][static_cast<int>(kind)]; }
+    // 马、车、炮、兵
+    Bitboard getStrongePieces(PieceColor color) const;
+    Piece getPiece(int index) const;
+
+    // 某位置棋子可走的位置（已排除同色棋子，未排除被将军的情况）
+    Bitboard getMoves(PieceColor bottomColor, int index, Piece piece) const;
+    // 攻击某位置的某方棋子（供判断将帅安全，含将帅对面）
+    Bitboard getAttackers(PieceColor bottomColor, int index, PieceColor color) const;
+    bool isAttacked(PieceColor bottomColor, int index, PieceColor color) const { return getAttackers(bottomColor, index, color).any(); }
+    bool isKilled(PieceColor bottomColor, PieceColor color) const;
+
+    KingSafety getKingSafety(PieceColor bottomColor, PieceColor color) const;
+    // 某位置棋子的合法走法（已排除被将军的情况）：仅被将军、走将帅或被牵制时逐一试走
+    Bitboard getLegalMoves(PieceColor bottomColor, int index, Piece piece, const KingSafety& safety) const;
+
+private:
+    Bitboard pieces_[2][7]{}, colorPieces_[2]{}, occupied_{};
+    uint64_t hashKey_{ 0 }; // 各棋子位置键值的异或
+
+    int __getKingIndex(PieceColor color) const;
+    bool __isLegalMove(PieceColor bottomColor, int findex, int tindex, Piece piece) const;
+    Bitboard __getRookMoves(int index) const;
+    Bitboard __getCannonMoves(int index) const;
+    Bitboard __getKnightMoves(int index) const;
+    Bitboard __getBishopMoves(bool isBottom, int index) const;
+};
+
+// 位棋盘掩码管理类
+class BitboardManager {
+public:
+    enum Direction { LEFT,
+        RIGHT,
+        DOWN,
+        UP };
+
+    static int getIndex(int row, int col) { return row * BOARDCOLNUM + col; }
+    static int getRow(int index) { return index / BOARDCOLNUM; }
+    static int getCol(int index) { return index % BOARDCOLNUM; }
+    // 序号递增的方向上首个棋子为最低位，否则为最高位
+    static bool isIncDirection(int dir) { return dir == RIGHT || dir == UP; }
+
+    static Bitboard getRay(int dir, int index);
+    // 某列全部位置，供查找同列棋子
+    static Bitboard getFile(int col);
+    static Bitboard getKingMoves(bool isBottom, int index);
+    static Bitboard getAdvisorMoves(bool isBottom, int index);
+    static Bitboard getPawnMoves(bool isBottom, int index);
+    // 马腿、象眼位置及对应的目标位置，无则为-1
+    static int getKnightLeg(int index, int legNo);
+    static Bitboard getKnightLegMoves(int index, int legNo);
+    static int getBishopEye(bool isBottom, int index, int eyeNo);
+    static int getBishopEyeMove(bool isBottom, int index, int eyeNo);
+    // 可攻击某位置的马：马腿位置及对应的马所在位置；可攻击某位置的兵所在位置
+    static int getKnightAttackLeg(int index, int legNo);
+    static Bitboard getKnightAttackFroms(int index, int legNo);
+    static Bitboard getPawnAttackFroms(bool isBottom, int index);
+    // Zobrist键值：棋子（按编码）位于某位置，黑方走棋
+    static uint64_t getZobristKey(Piece piece, int index);
+    static uint64_t getZobristSideKey();
+};
+}
+
+#endif
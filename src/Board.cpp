@@ -1,4 +1,4 @@
-#include "Board.h"
+﻿#include "Board.h"
 #include "Piece.h"
 #include "Seat.h"
 
@@ -7,12 +7,17 @@ namespace BoardSpace {
 /* ===== Board start. ===== */
 Board::Board(const wstring& pieceChars)
     : bottomColor_{ PieceColor::RED }
-    , pieces_{ make_shared<Pieces>() }
+    , sideColor_{ PieceColor::RED }
     , seats_{ make_shared<Seats>() } // make_shared:动态分配内存，初始化对象并指向它
 {
     setBoard(pieceChars);
 }
 
+uint64_t Board::hashKey() const
+{
+    return seats_->getHashKey() ^ (sideColor_ == PieceColor::BLACK ? BitboardManager::getZobristSideKey() : 0);
+}
+
 bool Board::isKilled(PieceColor color) const
 {
     return seats_->isKilled(bottomColor_, color);
@@ -34,7 +39,7 @@ const wstring Board::getZHStr(PRowCol_pair prowcol_pair) const
     return seats_->getZHStr(bottomColor_, prowcol_pair);
 }
 
-const RowCol_pair_vector Board::getPutRowCols(const SPiece& piece) const
+const RowCol_pair_vector Board::getPutRowCols(Piece piece) const
 {
     return seats_->getPutRowCols(bottomColor_, piece);
 }
@@ -49,30 +54,113 @@ const RowCol_pair_vector Board::getLiveRowCols(PieceColor color) const
     return seats_->getLiveRowCols(color);
 }
 
-const SPiece Board::doneMove(PRowCol_pair prowcol_pair) const
+void Board::generateLegalMoves(PieceColor color, MoveList& moveList) const
+{
+    seats_->generateLegalMoves(bottomColor_, color, moveList);
+}
+
+bool Board::isCanMove(PRowCol_pair prowcol_pair) const
 {
-    return seats_->doneMove(prowcol_pair);
+    return seats_->isCanMove(bottomColor_, MoveCode{ prowcol_pair });
 }
 
-void Board::undoMove(PRowCol_pair prowcol_pair, const SPiece& eatPie) const
+Piece Board::getPiece(int index) const
 {
-    seats_->undoMove(prowcol_pair, eatPie);
+    return seats_->getPiece(SeatManager::getSeatFromIndex(index));
 }
 
-void Board::setBoard(const wstring& pieceChars)
+Piece Board::doneMove(MoveCode moveCode)
+{
+    sideColor_ = PieceManager::getOtherColor(sideColor_);
+    return seats_->doneMove(moveCode);
+}
+
+void Board::undoMove(MoveCode moveCode, Piece eatPie)
+{
+    sideColor_ = PieceManager::getOtherColor(sideColor_);
+    seats_->undoMove(moveCode, eatPie);
+}
+
+long long Board::perft(PieceColor color, int depth)
+{
+    if (depth == 0)
+        return 1;
+    MoveList moveList{};
+    generateLegalMoves(color, moveList);
+    if (depth == 1)
+        return moveList.size();
+
+    long long count{ 0 };
+    PieceColor otherColor{ PieceManager::getOtherColor(color) };
+    for (auto moveCode : moveList) {
+        Piece eatPie{ doneMove(moveCode) };
+        count += perft(otherColor, depth - 1);
+        undoMove(moveCode, eatPie);
+    }
+    return count;
+}
+
+vector<pair<MoveCode, long long>> Board::divide(PieceColor color, int depth, int threadNum) const
+{
+    MoveList moveList{};
+    generateLegalMoves(color, moveList);
+    vector<pair<MoveCode, long long>> counts{};
+    for (auto moveCode : moveList)
+        counts.emplace_back(moveCode, 0);
+    if (threadNum <= 0)
+        threadNum = max(1u, thread::hardware_concurrency());
+    threadNum = min(threadNum, static_cast<int>(counts.size()));
+
+    // 各线程使用独立的棋盘，依次领取根节点着法
+    atomic<int> nextNo{ 0 };
+    wstring pieceChars{ getPieceChars() };
+    PieceColor otherColor{ PieceManager::getOtherColor(color) };
+    auto __work = [&]() {
+        Board board{ pieceChars };
+        for (int no = nextNo++; no < static_cast<int>(counts.size()); no = nextNo++) {
+            MoveCode moveCode{ counts[no].first };
+            Piece eatPie{ board.doneMove(moveCode) };
+            counts[no].second = board.perft(otherColor, depth - 1);
+            board.undoMove(moveCode, eatPie);
+        }
+    };
+    vector<thread> threads{};
+    for (int i = 1; i < threadNum; ++i)
+        threads.emplace_back(__work);
+    __work();
+    for (auto& th : threads)
+        th.join();
+    return counts;
+}
+
+void Board::setBoard(const wstring& pieceChars, PieceColor sideColor)
 {
     if (pieceChars.empty())
         return;
-    seats_->setBoardPieces(pieces_->getBoardPieces(pieceChars));
+    sideColor_ = sideColor;
+    seats_->setBoardPieces(pieceChars);
     bottomColor_ = seats_->getSideColor(true);
 }
 
 void Board::changeSide(const ChangeType ct)
 {
-    seats_->changeSide(ct, pieces_);
+    seats_->changeSide(ct); // 同时重算棋子位置的键值
     bottomColor_ = seats_->getSideColor(true);
 }
 
+void Board::setFEN(const wstring& FENplus)
+{
+    PieceColor sideColor{ getFENplusInfo(FENplus).color };
+    seats_->setFEN(FENplus);
+    sideColor_ = sideColor;
+    bottomColor_ = seats_->getSideColor(true);
+}
+
+const wstring Board::getFEN() const
+{
+    return seats_->getFEN();
+}
+
 const wstring Board::getPieceChars() const
 {
     return seats_->getPieceChars();
@@ -131,8 +219,7 @@ const wstring Board::toString() const
                            "　　＋－－－－－－－－－－－－－－－＋\n"; //全角字符，输出控制台屏幕使用
     //*/
     wostringstream wos{};
-    /*/ / Pieces test wos << L"pieces_:\n"
-                          << pieces_->toString() << L"\n";
+    /*
     // RowCols test
     wos << L"seats_:\n"
         << seats_->toString() << L"\n";
@@ -153,63 +240,144 @@ const wstring Board::toString() const
 }
 /* ===== Board end. ===== */
 
+FENplusInfo getFENplusInfo(const wstring& FENplus)
+{
+    FENplusInfo info{ FENplusToFEN(FENplus), PieceColor::RED, 0, 1 };
+    // 其后各字段以空格分隔，依次处理
+    int fieldNo{ 1 };
+    for (size_t pos = info.FEN.size(); pos < FENplus.size(); ++fieldNo) {
+        while (pos < FENplus.size() && FENplus[pos] == L' ')
+            ++pos;
+        size_t end{ min(FENplus.find(L' ', pos), FENplus.size()) };
+        if (pos == end)
+            break;
+        wstring field{ FENplus.substr(pos, end - pos) };
+        pos = end;
+        switch (fieldNo) {
+        case 1:
+            if (field != L"r" && field != L"w" && field != L"b")
+                throw runtime_error("FEN格式错误：走棋方无效!");
+            info.color = (field == L"b" ? PieceColor::BLACK : PieceColor::RED);
+            break;
+        case 2:
+        case 3: // 象棋不用，一般为'-'
+            break;
+        case 4:
+        case 5: {
+            int num{ 0 };
+            for (auto wch : field) {
+                if (wch < L'0' || wch > L'9')
+                    throw runtime_error("FEN格式错误：步数无效!");
+                num = num * 10 + (wch - L'0');
+            }
+            (fieldNo == 4 ? info.halfMoves : info.fullMoves) = num;
+            break;
+        }
+        default:
+            throw runtime_error("FEN格式错误：字段过多!");
+        }
+    }
+    return info;
+}
+
 const wstring FENplusToFEN(const wstring& FENplus)
 {
     return FENplus.substr(0, FENplus.find(L' '));
 }
 
-const wstring FENToFENplus(const wstring& FEN, PieceColor color)
+const wstring FENToFENplus(const wstring& FEN, PieceColor color, int halfMoves, int fullMoves)
 {
-    return (FEN + L" " + (color == PieceColor::RED ? L"r" : L"b") + L" - - 0 1");
+    return (FEN + (color == PieceColor::RED ? L" r - - " : L" b - - ")
+        + to_wstring(halfMoves) + L' ' + to_wstring(fullMoves));
 }
 
-const wstring pieCharsToFEN(const wstring& pieceChars)
+PieceColor FENplusToColor(const wstring& FENplus)
 {
-    assert(pieceChars.size() == SEATNUM);
-    wstring fen{};
-    wregex linerg{ LR"(.{9})" };
-    for (wsregex_token_iterator lineIter{
-             pieceChars.begin(), pieceChars.end(), linerg, 0 },
-         end{};
-         lineIter != end; ++lineIter) {
-        wostringstream wos{};
-        int num{ 0 };
-        for (auto wch : (*lineIter).str()) {
-            if (wch != PieceManager::nullChar()) {
-                if (num) {
-                    wos << num;
-                    num = 0;
-                }
-                wos << wch;
-            } else
-                ++num;
-        }
-        if (num)
-            wos << num;
-        fen.insert(0, wos.str()).insert(0, L"/");
-    }
-    fen.erase(0, 1);
+    return getFENplusInfo(FENplus).color;
+}
 
-    //assert(FENTopieChars(fen) == pieceChars);
-    return fen;
+const wstring pieCharsToFEN(const wstring& pieceChars)
+{
+    if (pieceChars.size() != SEATNUM)
+        throw runtime_error("棋子字符串长度不符!");
+    Seats seats{};
+    seats.setBoardPieces(pieceChars);
+    return seats.getFEN();
 }
 
 const wstring FENTopieChars(const wstring& fen)
 {
-    wstring pieceChars{};
-    wregex linerg{ LR"(/)" };
-    for (wsregex_token_iterator lineIter{ fen.begin(), fen.end(), linerg, -1 };
-         lineIter != wsregex_token_iterator{}; ++lineIter) {
-        wostringstream wos{};
-        for (auto wch : wstring{ *lineIter })
-            wos << (isdigit(wch)
-                    ? wstring(wch - L'0', PieceManager::nullChar())
-                    : wstring{ wch }); // ASCII: 0:48
-        pieceChars.insert(0, wos.str());
+    Seats seats{};
+    seats.setFEN(fen);
+    return seats.getPieceChars();
+}
+
+const wstring perftDivide(const wstring& FEN, PieceColor color, int depth, int threadNum)
+{
+    using namespace std::chrono;
+    wostringstream wos{};
+    Board board{ FENTopieChars(FEN) };
+    auto time0 = steady_clock::now();
+    auto counts = board.divide(color, max(depth, 1), threadNum);
+    double seconds{ duration<double>(steady_clock::now() - time0).count() };
+
+    long long nodes{ 0 };
+    for (auto& move_count : counts) {
+        auto prowcol_pair = move_count.first.getPRowCol_pair();
+        wos << PieceManager::getColICCSChar(prowcol_pair.first.second) << prowcol_pair.first.first
+            << PieceManager::getColICCSChar(prowcol_pair.second.second) << prowcol_pair.second.first
+            << L": " << move_count.second << L'\n';
+        nodes += move_count.second;
     }
+    wos << L"moves: " << counts.size() << L" nodes: " << nodes << L" time: " << seconds
+        << L"s nps: " << static_cast<long long>(nodes / max(seconds, 1e-6)) << L'\n';
+    return wos.str();
+}
+
+const wstring testPerft(int depth, int threadNum)
+{
+    using namespace std::chrono;
+    // 参考局面及各层叶节点数（第1-5层）
+    struct PerftRecord {
+        wstring FEN;
+        PieceColor color;
+        long long counts[5];
+    };
+    static const PerftRecord perftRecords[]{
+        { PieceManager::FirstFEN(), PieceColor::RED, { 44, 1920, 79666, 3290240, 133312995 } },
+        { L"5a3/4ak2r/6R2/8p/9/9/9/B4N2B/4K4/3c5", PieceColor::RED, { 33, 737, 21450, 448581, 12098565 } },
+        { L"5a3/4ak2r/6R2/8p/9/9/9/B4N2B/4K4/3c5", PieceColor::BLACK, { 25, 813, 16981, 485442, 10301606 } },
+        { L"r1ba1a3/4kn3/2n1b4/pNp1p1p1p/4c4/6P2/P1P2R2P/1CcC5/9/2BAKAB2", PieceColor::RED, { 38, 1128, 43929, 1339047, 53112976 } },
+        { L"1nbaka1n1/1r3C3/9/p1p5p/2b1p4/2P3C2/Pc2P1P1R/4B1N1B/9/R2AK4", PieceColor::RED, { 45, 1361, 57969, 1785795, 75542979 } },
+        { L"1nbC1a1n1/3k5/2r6/p1p3p1r/2P1p1b1p/9/P3P1P1P/1RN1Cc3/4R4/2BAKABN1", PieceColor::BLACK, { 39, 1475, 53753, 2193048, 78903764 } },
+    };
 
-    assert(fen == pieCharsToFEN(pieceChars));
-    return pieceChars;
+    wostringstream wos{};
+    bool isAllOk{ true };
+    long long allNodes{ 0 };
+    double allSeconds{ 0 };
+    depth = max(1, min(depth, 5));
+    for (auto& record : perftRecords) {
+        Board board{ FENTopieChars(record.FEN) };
+        auto time0 = steady_clock::now();
+        long long nodes{ 0 };
+        for (auto& move_count : board.divide(record.color, depth, threadNum))
+            nodes += move_count.second;
+        double seconds{ duration<double>(steady_clock::now() - time0).count() };
+
+        bool isOk{ nodes == record.counts[depth - 1] };
+        isAllOk = isAllOk && isOk;
+        allNodes += nodes;
+        allSeconds += seconds;
+        wos << record.FEN << (record.color == PieceColor::RED ? L" 红" : L" 黑") << L" depth:" << depth
+            << L" nodes:" << nodes << (isOk ? L" ok" : L" 错误！应为");
+        if (!isOk)
+            wos << record.counts[depth - 1];
+        wos << L" time:" << seconds << L"s\n";
+    }
+    wos << (isAllOk ? L"全部正确" : L"存在错误") << L" nodes:" << allNodes << L" time:" << allSeconds
+        << L"s nps:" << static_cast<long long>(allNodes / max(allSeconds, 1e-6)) << L'\n';
+    return wos.str();
 }
 
 const wstring testBoard()
@@ -1,4 +1,4 @@
-#ifndef BOARD_H
+﻿#ifndef BOARD_H
 #define BOARD_H
 
 #include "ChessType.h"
@@ -10,36 +10,60 @@ public:
     Board(const wstring& pieceChars = wstring{});
 
     bool isBottomSide(PieceColor color) const { return bottomColor_ == color; }
+    // 局面的Zobrist键值：棋子位置及走棋方
+    uint64_t hashKey() const;
     bool isKilled(PieceColor color) const;
     bool isDied(PieceColor color) const;
 
     PRowCol_pair getPRowCol_pair(const wstring& str) const;
     const wstring getZHStr(PRowCol_pair prowcol_pair) const;
 
-    const RowCol_pair_vector getPutRowCols(const SPiece& piece) const;
+    const RowCol_pair_vector getPutRowCols(Piece piece) const;
     const RowCol_pair_vector getCanMoveRowCols(RowCol_pair rowcol_pair) const;
     const RowCol_pair_vector getLiveRowCols(PieceColor color) const;
+    // 某方全部合法着法；着法是否合法（供输入着法时校验）
+    void generateLegalMoves(PieceColor color, MoveList& moveList) const;
+    bool isCanMove(PRowCol_pair prowcol_pair) const;
+    Piece getPiece(int index) const; // index = 行 * 9 + 列
 
-    const SPiece doneMove(PRowCol_pair prowcol_pair) const;
-    void undoMove(PRowCol_pair prowcol_pair, const SPiece& eatPie) const;
+    Piece doneMove(MoveCode moveCode);
+    void undoMove(MoveCode moveCode, Piece eatPie);
 
-    void setBoard(const wstring& pieceChars);
+    // 走法生成测试：某方先走depth层的叶节点数；根节点各着法的叶节点数（多线程分担）
+    long long perft(PieceColor color, int depth);
+    vector<pair<MoveCode, long long>> divide(PieceColor color, int depth, int threadNum = 0) const;
+
+    void setBoard(const wstring& pieceChars, PieceColor sideColor = PieceColor::RED);
+    // 由六字段FEN设置棋子及走棋方；取得棋子布局字段
+    void setFEN(const wstring& FENplus);
+    const wstring getFEN() const;
     void changeSide(const ChangeType ct);
 
     const wstring getPieceChars() const;
     const wstring toString() const;
 
 private:
-    PieceColor bottomColor_;
-    shared_ptr<Pieces> pieces_;
+    PieceColor bottomColor_, sideColor_; // sideColor_:当前走棋方
     shared_ptr<Seats> seats_;
 };
 
+// 六字段FEN：棋子布局 走棋方(r/w、b) - - 无吃子半回合数 回合数
+struct FENplusInfo {
+    wstring FEN;
+    PieceColor color;
+    int halfMoves, fullMoves;
+};
+
+FENplusInfo getFENplusInfo(const wstring& FENplus); // 格式错误则抛出异常，缺少的字段取默认值
 const wstring FENplusToFEN(const wstring& FENplus);
-const wstring FENToFENplus(const wstring& FEN, PieceColor color);
+const wstring FENToFENplus(const wstring& FEN, PieceColor color, int halfMoves = 0, int fullMoves = 1);
+PieceColor FENplusToColor(const wstring& FENplus);
 const wstring pieCharsToFEN(const wstring& pieceChars); // 便利函数，下同
 const wstring FENTopieChars(const wstring& fen);
 
+const wstring perftDivide(const wstring& FEN, PieceColor color, int depth, int threadNum = 0);
+const wstring testPerft(int depth, int threadNum = 0); // 参考局面的叶节点数校验及速度
+
 const wstring testBoard();
 }
 #endif
\ No newline at end of file
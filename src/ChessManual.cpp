@@ -3,7 +3,16 @@
 #include "Piece.h"
 #include "Seat.h"
 #include "Tools.h"
-#include "json.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace ChessManualSpace {
 
@@ -16,98 +25,173 @@ static const map<RecFormat, string> fmt_ext{
     { RecFormat::PGN_CC, ".pgn_cc" }
 };
 
-wstring_convert<codecvt_utf8<wchar_t>> wscvt; // 未能成功调用
+// 是否为棋谱文件的扩展名
+static bool isManualExt(const string& ext)
+{
+    return find_if(fmt_ext.begin(), fmt_ext.end(),
+               [&](const pair<RecFormat, string>& fmtext) { return fmtext.second == ext; })
+        != fmt_ext.end();
+}
 
 static const wchar_t FENKey[] = L"FEN";
+static constexpr size_t MovesReserve{ 1024 }; // 着法节点的初始容量，多数棋谱无需再分配
+
+// XQF文件头（1024字节）各字段的偏移位置
+enum XQFHeadOffset {
+    XQF_Signature = 0, // 文件标记'XQ'=$5158
+    XQF_Version = 2,
+    XQF_KeyMask = 3,
+    XQF_ProductId = 4, // 产品(厂商的产品号)
+    XQF_KeyOrA = 8, // KeyOrA..KeyOrD
+    XQF_KeysSum = 12, // KeysSum, KeyXY, KeyXYf, KeyXYt
+    XQF_QiziXY = 16, // 32个棋子的原始位置
+    XQF_PlayStepNo = 48,
+    XQF_WhoPlay = 50,
+    XQF_PlayResult = 51,
+    XQF_PlayNodes = 52,
+    XQF_PTreePos = 56,
+    XQF_CodeA_H = 64,
+    XQF_HeadSize = 1024
+};
 
-/* ===== ChessManual::Move start. ===== */
-int ChessManual::Move::frowcol() const { return SeatManager::getRowCol(prowcol_pair_.first); }
+// XQF文件头中以空字符结尾的文本字段
+struct XQFTextField {
+    const wchar_t* key;
+    int offset, size;
+};
+static constexpr XQFTextField XQFTextFields[]{
+    { L"TitleA", 80, 64 }, { L"Event", 208, 64 }, { L"Date", 272, 16 }, { L"Site", 288, 16 },
+    { L"Red", 304, 16 }, { L"Black", 320, 16 }, { L"Opening", 336, 64 },
+    { L"RMKWriter", 464, 16 }, { L"Author", 480, 16 }
+};
 
-int ChessManual::Move::trowcol() const { return SeatManager::getRowCol(prowcol_pair_.second); }
+static constexpr char XQFCopyright[]{ "[(C) Copyright Mr. Dong Shiwei.]" };
 
-const wstring ChessManual::Move::iccs() const
+// 由钥匙生成密钥，保持为<256
+static unsigned char getXQFKey(unsigned char bKey, unsigned char cKey)
 {
-    wostringstream wos{};
-    wos << PieceManager::getColICCSChar(prowcol_pair_.first.second) << prowcol_pair_.first.first
-        << PieceManager::getColICCSChar(prowcol_pair_.second.second) << prowcol_pair_.second.first;
-    return wos.str();
+    return (((((bKey * bKey) * 3 + 9) * 3 + 8) * 2 + 1) * 3 + 8) * cKey;
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::Move::addNext(const PRowCol_pair& prowcol_pair, const wstring& remark)
+// XQF文件（version > 10）的各项密钥，由文件头中的钥匙计算，读写共用
+struct XQFKeys {
+    unsigned char KeyXY, KeyXYf, KeyXYt, F32Keys[PIECENUM];
+    int KeyRMKSize;
+};
+
+static XQFKeys getXQFKeys(const char* head)
 {
-    auto nextMove = __addNext();
-    nextMove->setPRowCol_pair(prowcol_pair);
-    nextMove->setRemark(remark);
-    return next_ = nextMove;
+    char headKeyMask{ head[XQF_KeyMask] }, headKeysSum{ head[XQF_KeysSum] }, headKeyXY{ head[XQF_KeysSum + 1] },
+        headKeyXYf{ head[XQF_KeysSum + 2] }, headKeyXYt{ head[XQF_KeysSum + 3] }; // 加密的钥匙和/棋子布局位置钥匙/棋谱起点钥匙/棋谱终点钥匙
+    XQFKeys keys{};
+    keys.KeyXY = getXQFKey(headKeyXY, headKeyXY);
+    keys.KeyXYf = getXQFKey(headKeyXYf, keys.KeyXY);
+    keys.KeyXYt = getXQFKey(headKeyXYt, keys.KeyXYf);
+    keys.KeyRMKSize = (static_cast<unsigned char>(headKeysSum) * 256 + static_cast<unsigned char>(headKeyXY)) % 32000 + 767; // % 65536
+    int KeyBytes[4]{
+        (headKeysSum & headKeyMask) | head[XQF_KeyOrA],
+        (headKeyXY & headKeyMask) | head[XQF_KeyOrA + 1],
+        (headKeyXYf & headKeyMask) | head[XQF_KeyOrA + 2],
+        (headKeyXYt & headKeyMask) | head[XQF_KeyOrA + 3]
+    };
+    for (int i = 0; i != PIECENUM; ++i)
+        keys.F32Keys[i] = XQFCopyright[i] & KeyBytes[i % 4]; // ord(c)
+    return keys;
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::Move::addOther(const PRowCol_pair& prowcol_pair, const wstring& remark)
+// 读取整个文件到缓冲区
+static string readBytes(istream& is)
 {
-
-    auto otherMove = __addOther();
-    otherMove->setPRowCol_pair(prowcol_pair);
-    otherMove->setRemark(remark);
-    return other_ = otherMove;
+    is.seekg(0, ios_base::end);
+    streamoff size{ is.tellg() };
+    if (!is || size < 0)
+        throw runtime_error("文件读取失败");
+    string bytes(static_cast<size_t>(size), '\0');
+    is.seekg(0);
+    is.read(&bytes[0], bytes.size());
+    return bytes;
 }
 
-vector<shared_ptr<ChessManual::Move>> ChessManual::Move::getPrevMoves()
+// BIN文件版本2：文件头"CMB"+版本号，长度及计数为变长整数，文本为UTF-8，末尾为CRC-32校验值；
+// 旧版本（版本1）无文件头，首字节仅用高3位标志，不会与文件头冲突
+static constexpr char BINMagic[]{ "CMB" };
+static constexpr int BINMagicSize{ 3 }, BINVersion{ 2 }, BINCheckSize{ 4 };
+// 着法节点：低14位为着法编码，另两位标志有无下着、变着
+static constexpr int BINNextFlag{ 0x8000 }, BINOtherFlag{ 0x4000 }, BINCodeMask{ 0x3FFF };
+
+struct CRC32Table {
+    uint32_t values[256];
+};
+
+static constexpr CRC32Table getCRC32Table()
 {
-    SMove thisMove{ shared_from_this() }, preMove{};
-    vector<SMove> moves{ thisMove };
-    while (preMove = thisMove->prev()) {
-        moves.push_back(preMove);
-        thisMove = preMove;
+    CRC32Table table{};
+    for (uint32_t i = 0; i != 256; ++i) {
+        uint32_t value{ i };
+        for (int bit = 0; bit != 8; ++bit)
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+        table.values[i] = value;
     }
-    reverse(moves.begin(), moves.end());
-    return moves;
+    return table;
 }
+static constexpr CRC32Table CRC32Values{ getCRC32Table() };
 
-const wstring ChessManual::Move::toString()
+static uint32_t getCRC32(const char* data, size_t size)
 {
-    wostringstream wos{};
-    wos << setfill(L'0');
-    auto __write = [&](const SMove& move) {
-        if (move)
-            wos << setw(2) << move->frowcol() << L"->" << setw(2) << move->trowcol()
-                << L' ' << setw(4) << move->iccs() << L' ' << setw(4) << move->zh()
-                << L'@' << (move->eatPie() ? move->eatPie()->name() : L'-');
-        wos << L"\n\n";
-    };
+    uint32_t crc{ 0xFFFFFFFF };
+    for (size_t i = 0; i != size; ++i)
+        crc = CRC32Values.values[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
 
-    wos << L"前着：";
-    __write(prev());
+// 定长无符号整数（低字节在前）
+static void appendUInt(string& bytes, uint64_t value, int size)
+{
+    for (int i = 0; i != size; ++i)
+        bytes.push_back(static_cast<char>(value >> (i * 8)));
+}
 
-    wos << L"现在：";
-    __write(shared_from_this());
+static uint64_t getUInt(const char* data, int size)
+{
+    uint64_t value{ 0 };
+    for (int i = size - 1; i >= 0; --i)
+        value = value << 8 | static_cast<unsigned char>(data[i]);
+    return value;
+}
 
-    wos << L"下着：";
-    __write(next());
+// 无符号变长整数（每字节7位，低位在前）
+static void appendVarint(string& bytes, uint32_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        bytes.push_back(static_cast<char>(value | 0x80));
+    bytes.push_back(static_cast<char>(value));
+}
 
-    wos << L"变着：";
-    __write(other());
+static void appendUTF8(string& bytes, const wstring& wstr)
+{
+    string str{ Tools::ws2utf8(wstr) };
+    appendVarint(bytes, str.size());
+    bytes.append(str);
+}
 
-    wos << L"注解：" << remark() << L'\n'
-        << L" next:" << nextNo_ << L" other:" << otherNo_ << L" CC_Col:" << CC_ColNo_ << L'\n';
+/* ===== ChessManual::Move start. ===== */
+int ChessManual::Move::frowcol() const { return SeatManager::getRowCol(getPRowCol_pair().first); }
 
-    return wos.str();
-}
+int ChessManual::Move::trowcol() const { return SeatManager::getRowCol(getPRowCol_pair().second); }
 
-shared_ptr<ChessManual::Move>& ChessManual::Move::__addNext()
+const wstring ChessManual::Move::iccs() const
 {
-    auto nextMove = make_shared<Move>();
-    nextMove->setNextNo(nextNo_ + 1);
-    nextMove->setOtherNo(otherNo_);
-    nextMove->setPrev(weak_ptr<Move>(shared_from_this()));
-    return next_ = nextMove;
+    wostringstream wos{};
+    auto prowcol_pair = getPRowCol_pair();
+    wos << PieceManager::getColICCSChar(prowcol_pair.first.second) << prowcol_pair.first.first
+        << PieceManager::getColICCSChar(prowcol_pair.second.second) << prowcol_pair.second.first;
+    return wos.str();
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::Move::__addOther()
+void ChessManual::Move::setZhStr(const wstring& zhStr)
 {
-    auto otherMove = make_shared<Move>();
-    otherMove->setNextNo(nextNo_);
-    otherMove->setOtherNo(otherNo_ + 1);
-    otherMove->setPrev(weak_ptr<Move>(shared_from_this()));
-    return other_ = otherMove;
+    assert(zhStr.size() == ZhLen_);
+    copy(zhStr.begin(), zhStr.end(), zhStr_);
 }
 /* ===== ChessManual::Move end. ===== */
 
@@ -124,55 +208,58 @@ void ChessManual::reset()
 {
     __setFENplusFromFEN(PieceManager::FirstFEN(), PieceColor::RED);
     __setBoardFromInfo();
-    currentMove_ = rootMove_ = make_shared<Move>();
+    __clearMoves();
     movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::addNextMove(
-    SMove& move, const PRowCol_pair& prowcol_pair, const wstring& remark) const
+ChessManual::MoveIndex ChessManual::addNextMove(
+    MoveIndex move, const PRowCol_pair& prowcol_pair, const wstring& remark)
 {
-    return move->addNext(prowcol_pair, remark);
+    return __addMove(move, false, prowcol_pair, remark);
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::addOtherMove(
-    SMove& move, const PRowCol_pair& prowcol_pair, const wstring& remark) const
+ChessManual::MoveIndex ChessManual::addOtherMove(
+    MoveIndex move, const PRowCol_pair& prowcol_pair, const wstring& remark)
 {
-    return move->addOther(prowcol_pair, remark);
+    return __addMove(move, true, prowcol_pair, remark);
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::addNextMove(
-    SMove& move, const wstring& str, RecFormat fmt, const wstring& remark) const
+ChessManual::MoveIndex ChessManual::addNextMove(
+    MoveIndex move, const wstring& str, RecFormat fmt, const wstring& remark)
 {
-    return move->addNext(__getPRowCol_pair(str, fmt), remark);
+    return __addMove(move, false, __getPRowCol_pair(str, fmt), remark);
 }
 
-shared_ptr<ChessManual::Move>& ChessManual::addOtherMove(
-    SMove& move, const wstring& str, RecFormat fmt, const wstring& remark) const
+ChessManual::MoveIndex ChessManual::addOtherMove(
+    MoveIndex move, const wstring& str, RecFormat fmt, const wstring& remark)
 {
-    return move->addOther(__getPRowCol_pair(str, fmt), remark);
+    return __addMove(move, true, __getPRowCol_pair(str, fmt), remark);
 }
 
 void ChessManual::go()
 {
-    if (currentMove_->next()) {
-        currentMove_ = currentMove_->next();
+    if (moves_[currentMove_].next() != NullMove) {
+        currentMove_ = moves_[currentMove_].next();
         __done(currentMove_);
     }
 }
 
 void ChessManual::back()
 {
-    if (currentMove_->prev()) {
+    MoveIndex prev{ moves_[currentMove_].prev() };
+    if (prev != NullMove) {
         __undo(currentMove_);
-        currentMove_ = currentMove_->prev();
+        if (moves_[prev].other() == currentMove_) // 变着退回同级的前一着法，与goOther互逆
+            __done(prev);
+        currentMove_ = prev;
     }
 }
 
 void ChessManual::goOther()
 {
-    if (currentMove_ != rootMove_ && currentMove_->other()) {
+    if (currentMove_ != rootMove_ && moves_[currentMove_].other() != NullMove) {
         __undo(currentMove_);
-        currentMove_ = currentMove_->other();
+        currentMove_ = moves_[currentMove_].other();
         __done(currentMove_);
     }
 }
@@ -187,7 +274,7 @@ void ChessManual::goInc(int inc)
 
 void ChessManual::goEnd()
 {
-    while (currentMove_->next())
+    while (moves_[currentMove_].next() != NullMove)
         go();
 }
 
@@ -198,119 +285,155 @@ void ChessManual::backFirst()
 
 void ChessManual::changeSide(ChangeType ct)
 {
-    vector<SMove> prevMoves{};
+    vector<MoveIndex> prevMoves{};
     if (currentMove_ != rootMove_)
-        prevMoves = currentMove_->getPrevMoves();
+        prevMoves = __getPrevMoves(currentMove_);
     __backTo(rootMove_);
     board_->changeSide(ct);
 
     if (ct != ChangeType::EXCHANGE) {
         auto changeRowcol = (ct == ChangeType::ROTATE ? &SeatManager::getRotate : &SeatManager::getSymmetry);
         //auto changeRowcol = mem_fn(ct == ChangeType::ROTATE ? &SeatManager::getRotate : &SeatManager::getSymmetry);
-        function<void(const SMove&)>
-            __resetMove = [&](const SMove& move) {
-                auto move_cp = move; //复制一个副本，用来修改内部数据
-                move_cp->setPRowCol_pair(make_pair(changeRowcol(move->getPRowCol_pair().first),
-                    changeRowcol(move->getPRowCol_pair().second)));
-                if (move->next())
-                    __resetMove(move->next());
-                if (move->other())
-                    __resetMove(move->other());
-            };
-        if (rootMove_->next())
-            __resetMove(rootMove_->next());
+        for (size_t move = rootMove_ + 1; move < moves_.size(); ++move) { // 节点集中存放，无需遍历树
+            auto prowcol_pair = moves_[move].getPRowCol_pair();
+            moves_[move].setPRowCol_pair(make_pair(changeRowcol(prowcol_pair.first), changeRowcol(prowcol_pair.second)));
+        }
     }
 
-    __setFENplusFromFEN(pieCharsToFEN(board_->getPieceChars()), PieceColor::RED);
-    if (ct != ChangeType::ROTATE)
-        __setMoveZhStrAndNums();
+    __setFENplusFromFEN(board_->getFEN(), PieceColor::RED);
+    hasZhStr_ = false;
+    __setMoveHashKeys(); // 各着法的局面均已改变，棋盘此时位于初始局面
     for (auto& move : prevMoves)
         __done(move);
+    if (!prevMoves.empty())
+        currentMove_ = prevMoves.back(); // 棋盘与当前着法保持一致
 }
 
 void ChessManual::read(const string& infilename)
 {
     if (infilename.empty())
         return;
-    ifstream is;
-    wifstream wis;
-    RecFormat fmt{ RecFormat::XQF };
-    fmt = getRecFormat(Tools::getExtStr(infilename));
-    if (fmt == RecFormat::XQF || fmt == RecFormat::BIN || fmt == RecFormat::JSON)
-        is.open(infilename, ios_base::binary);
-    else
-        wis.open(infilename);
-    if (is.fail() || wis.fail())
+    ifstream is{ infilename, ios_base::binary };
+    if (is.fail())
         return;
 
+    string bytes{ readBytes(is) };
+    string ext{ Tools::getExtStr(infilename) };
+    RecFormat fmt{ getRecFormat(ext) };
+    if (ext.empty() || isManualExt(ext))
+        detectRecFormat(bytes, fmt); // 内容可识别时以内容为准，否则按扩展名
+    readData(bytes, fmt);
+}
+
+void ChessManual::readData(string& bytes, RecFormat fmt)
+{
+    info_.clear(); // 与新建的棋谱对象一致，读取结果与之前的内容无关
+    reset();
     switch (fmt) {
     case RecFormat::XQF:
-        __readXQF(is);
+        __readXQF(bytes);
         break;
     case RecFormat::BIN:
-        __readBIN(is);
+        __readBIN(bytes.data(), bytes.size());
         break;
     case RecFormat::JSON:
-        __readJSON(is);
+        __readJSON(bytes.data(), bytes.size());
         break;
     case RecFormat::PGN_ICCS:
-        __readInfo_PGN(wis);
-        __readMove_PGN_ICCSZH(wis, RecFormat::PGN_ICCS);
-        break;
     case RecFormat::PGN_ZH:
-        __readInfo_PGN(wis);
-        __readMove_PGN_ICCSZH(wis, RecFormat::PGN_ZH);
-        break;
-    case RecFormat::PGN_CC:
-        __readInfo_PGN(wis);
-        __readMove_PGN_CC(wis);
-        break;
+    case RecFormat::PGN_CC: {
+        const wstring text{ Tools::decodeText(bytes) }; // 文本编码与区域设置无关：UTF-8或GBK
+        size_t pos{ 0 };
+        __readInfo_PGN(text, pos);
+        if (fmt == RecFormat::PGN_CC)
+            __readMove_PGN_CC(text, pos);
+        else
+            __readMove_PGN_ICCSZH(text, pos, fmt);
+    } break;
     default:
         break;
     }
     currentMove_ = rootMove_;
-    __setMoveZhStrAndNums();
+    __setMoveNums();
+    __setMoveHashKeys();
 }
 
 void ChessManual::write(const string& outfilename)
 {
     if (outfilename.empty())
         return;
-    ofstream os{};
-    wofstream wos{};
-    RecFormat fmt{ RecFormat::PGN_CC };
-    fmt = getRecFormat(Tools::getExtStr(outfilename));
-    if (fmt == RecFormat::XQF || fmt == RecFormat::BIN || fmt == RecFormat::JSON)
-        os.open(outfilename, ios_base::binary);
-    else
-        wos.open(outfilename);
-    if (os.fail() || wos.fail())
-        return;
+    RecFormat fmt{ getRecFormat(Tools::getExtStr(outfilename)) };
+    ofstream os{ outfilename, ios_base::binary };
+    if (os.fail())
+        throw runtime_error("文件创建失败：" + outfilename);
 
+    string bytes{};
     switch (fmt) {
     case RecFormat::XQF:
+        __writeXQF(os);
         break;
     case RecFormat::BIN:
-        __writeBIN(os);
+        __writeBIN(bytes);
         break;
     case RecFormat::JSON:
-        __writeJSON(os);
+        __writeJSON(bytes);
         break;
     case RecFormat::PGN_ICCS:
-        __writeInfo_PGN(wos);
-        __writeMove_PGN_ICCSZH(wos, RecFormat::PGN_ICCS);
-        break;
     case RecFormat::PGN_ZH:
+    case RecFormat::PGN_CC: {
+        // 文本一律输出UTF-8；按CRLF换行，注解中原有的"\r\n"读取后不变
+        Tools::EncodeStreambuf buf{ os, Tools::Charset::UTF8, true };
+        wostream wos{ &buf };
+        if (fmt != RecFormat::PGN_ICCS)
+            __requireZhStrs();
         __writeInfo_PGN(wos);
-        __writeMove_PGN_ICCSZH(wos, RecFormat::PGN_ZH);
-        break;
-    case RecFormat::PGN_CC:
-        __writeInfo_PGN(wos);
-        __writeMove_PGN_CC(wos);
-        break;
+        if (fmt == RecFormat::PGN_CC)
+            __writeMove_PGN_CC(wos);
+        else
+            __writeMove_PGN_ICCSZH(wos, fmt);
+    } break;
     default:
         break;
     }
+    os.write(bytes.data(), bytes.size());
+    os.close();
+    if (os.fail())
+        throw runtime_error("文件写入失败：" + outfilename);
+}
+
+void ChessManual::readBIN(const char* data, size_t size)
+{
+    info_.clear();
+    reset();
+    __readBIN(data, size);
+    currentMove_ = rootMove_;
+    __setMoveNums();
+    __setMoveHashKeys();
+}
+
+const string ChessManual::getBIN() const
+{
+    string bytes{};
+    __writeBIN(bytes);
+    return bytes;
+}
+
+uint64_t ChessManual::getHashKey() const { return board_->hashKey(); }
+
+const RowCol_pair_vector ChessManual::findPosition(uint64_t hashKey)
+{
+    __requireHashKeys();
+    RowCol_pair_vector coords{};
+    for (auto& amove : moves_)
+        if (amove.hashKey() == hashKey)
+            coords.emplace_back(amove.CC_ColNo(), amove.nextNo());
+    return coords;
+}
+
+const wstring ChessManual::getInfo(const wstring& key) const
+{
+    auto kv = info_.find(key);
+    return kv != info_.end() ? kv->second : wstring{};
 }
 
 bool ChessManual::isBottomSide(PieceColor color) const { return board_->isBottomSide(color); }
@@ -319,10 +442,15 @@ const wstring ChessManual::getPieceChars() const { return board_->getPieceChars(
 
 const wstring ChessManual::getBoardStr() const { return board_->toString(); }
 
-const wstring ChessManual::getCurmoveStr() const { return currentMove_->toString(); }
+const wstring ChessManual::getCurmoveStr()
+{
+    __requireZhStrs();
+    return __moveStr(currentMove_);
+}
 
-const wstring ChessManual::getMoveStr() const
+const wstring ChessManual::getMoveStr()
 {
+    __requireZhStrs();
     wostringstream wos{};
     __writeMove_PGN_CC(wos);
     return wos.str();
@@ -335,17 +463,18 @@ const wstring ChessManual::toString()
     // Board test
     //wos << board_->toString() << L'\n';
 
+    __requireZhStrs();
     __writeInfo_PGN(wos);
     __writeMove_PGN_CC(wos);
 
     /*
     __backTo(rootMove_);
-    vector<SMove> preMoves{};
+    vector<MoveIndex> preMoves{};
     function<void(bool)>
         __printMoveBoard = [&](bool isOther) {
             isOther ? goOther() : go();
-            wos << board_->toString() << currentMove_->toString() << L"\n\n";
-            if (currentMove_->other()) {
+            wos << board_->toString() << __moveStr(currentMove_) << L"\n\n";
+            if (moves_[currentMove_].other() != NullMove) {
                 preMoves.push_back(currentMove_);
                 __printMoveBoard(true);
                 // 变着之前着在返回时，应予执行
@@ -355,31 +484,169 @@ const wstring ChessManual::toString()
                     preMoves.pop_back();
                 }
             }
-            if (currentMove_->next()) {
+            if (moves_[currentMove_].next() != NullMove) {
                 __printMoveBoard(false);
             }
             back();
         };
-    if (currentMove_->next())
+    if (moves_[currentMove_].next() != NullMove)
         __printMoveBoard(false);
     //*/
     return wos.str();
 }
 
-void ChessManual::__backTo(const SMove& move)
+void ChessManual::__clearMoves()
+{
+    moves_.clear();
+    remarks_.clear();
+    moves_.reserve(MovesReserve);
+    moves_.emplace_back(); // 根节点
+    currentMove_ = rootMove_ = 0;
+    hasZhStr_ = hasHashKey_ = false;
+}
+
+ChessManual::MoveIndex ChessManual::__addMove(MoveIndex move, bool isOther)
+{
+    MoveIndex newMove = moves_.size();
+    moves_.emplace_back(); // 可能重新分配，此后不能再使用之前取得的节点引用
+    Move &preMove{ moves_[move] }, &curMove{ moves_[newMove] };
+    curMove.setNextNo(preMove.nextNo() + (isOther ? 0 : 1));
+    curMove.setOtherNo(preMove.otherNo() + (isOther ? 1 : 0));
+    curMove.setPrev(move);
+    isOther ? preMove.setOther(newMove) : preMove.setNext(newMove);
+    hasZhStr_ = hasHashKey_ = false;
+    return newMove;
+}
+
+ChessManual::MoveIndex ChessManual::__addMove(MoveIndex move, bool isOther, const PRowCol_pair& prowcol_pair, const wstring& remark)
+{
+    MoveIndex newMove{ __addMove(move, isOther) };
+    moves_[newMove].setPRowCol_pair(prowcol_pair);
+    __setRemark(newMove, remark);
+    return newMove;
+}
+
+const wstring& ChessManual::__remark(MoveIndex move) const
+{
+    static const wstring emptyRemark{};
+    int remarkNo{ moves_[move].remarkNo() };
+    return remarkNo < 0 ? emptyRemark : remarks_[remarkNo];
+}
+
+void ChessManual::__setRemark(MoveIndex move, const wstring& remark)
+{
+    int remarkNo{ moves_[move].remarkNo() };
+    if (remarkNo >= 0)
+        remarks_[remarkNo] = remark;
+    else if (!remark.empty()) {
+        moves_[move].setRemarkNo(remarks_.size());
+        remarks_.push_back(remark);
+    }
+}
+
+vector<ChessManual::MoveIndex> ChessManual::__getPrevMoves(MoveIndex move) const
+{
+    vector<MoveIndex> moves{};
+    while (move != rootMove_) {
+        moves.push_back(move);
+        MoveIndex prev{ moves_[move].prev() };
+        while (moves_[prev].other() == move) { // 变着的前着为同级着法，跳过直至上一着
+            move = prev;
+            prev = moves_[move].prev();
+        }
+        move = prev;
+    }
+    reverse(moves.begin(), moves.end());
+    return moves;
+}
+
+const wstring ChessManual::__moveStr(MoveIndex move) const
+{
+    wostringstream wos{};
+    wos << setfill(L'0');
+    auto __write = [&](MoveIndex move) {
+        if (move != NullMove) {
+            const Move& amove{ moves_[move] };
+            wos << setw(2) << amove.frowcol() << L"->" << setw(2) << amove.trowcol()
+                << L' ' << setw(4) << amove.iccs() << L' ' << setw(4) << amove.zh()
+                << L'@' << (amove.eatPie() ? amove.eatPie().name() : L'-');
+        }
+        wos << L"\n\n";
+    };
+    const Move& amove{ moves_[move] };
+
+    wos << L"前着：";
+    __write(amove.prev());
+
+    wos << L"现在：";
+    __write(move);
+
+    wos << L"下着：";
+    __write(amove.next());
+
+    wos << L"变着：";
+    __write(amove.other());
+
+    wos << L"注解：" << __remark(move) << L'\n'
+        << L" next:" << amove.nextNo() << L" other:" << amove.otherNo() << L" CC_Col:" << amove.CC_ColNo() << L'\n';
+
+    return wos.str();
+}
+
+template <typename Enter, typename Leave, typename Branch>
+void ChessManual::__traverse(MoveIndex move, bool otherFirst, Enter&& enter, Leave&& leave, Branch&& branch) const
+{
+    auto __first = [&](MoveIndex move) { return otherFirst ? moves_[move].other() : moves_[move].next(); };
+    auto __second = [&](MoveIndex move) { return otherFirst ? moves_[move].next() : moves_[move].other(); };
+    vector<MoveIndex> path{}; // 先访问子树尚未遍历完毕的节点，后访问子树为尾部转移，无需入栈
+    bool isOther{ false };
+    while (true) {
+        enter(move, isOther);
+        MoveIndex first{ __first(move) };
+        if (first != NullMove) {
+            path.push_back(move);
+            move = first;
+            isOther = otherFirst;
+            continue;
+        }
+        while (true) {
+            leave(move);
+            MoveIndex second{ __second(move) };
+            if (second != NullMove) {
+                branch(move);
+                move = second;
+                isOther = !otherFirst;
+                break;
+            }
+            if (path.empty())
+                return;
+            move = path.back();
+            path.pop_back();
+        }
+    }
+}
+
+template <typename Enter>
+void ChessManual::__traverse(MoveIndex move, bool otherFirst, Enter&& enter) const
+{
+    auto __skip = [](MoveIndex) {};
+    __traverse(move, otherFirst, enter, __skip, __skip);
+}
+
+void ChessManual::__backTo(MoveIndex move)
 {
     while (currentMove_ != rootMove_ && currentMove_ != move)
         back();
 }
 
-void ChessManual::__done(const SMove& move)
+void ChessManual::__done(MoveIndex move)
 {
-    move->setEatPie(board_->doneMove(move->getPRowCol_pair()));
+    moves_[move].setEatPie(board_->doneMove(moves_[move].moveCode()));
 }
 
-void ChessManual::__undo(const SMove& move)
+void ChessManual::__undo(MoveIndex move)
 {
-    board_->undoMove(move->getPRowCol_pair(), move->eatPie());
+    board_->undoMove(moves_[move].moveCode(), moves_[move].eatPie());
 }
 
 void ChessManual::__setFENplusFromFEN(const wstring& FEN, PieceColor color)
@@ -389,7 +656,7 @@ void ChessManual::__setFENplusFromFEN(const wstring& FEN, PieceColor color)
 
 void ChessManual::__setBoardFromInfo()
 {
-    board_->setBoard(FENTopieChars(FENplusToFEN(info_.at(FENKey))));
+    board_->setFEN(info_.at(FENKey));
 }
 
 PRowCol_pair ChessManual::__getPRowCol_pair(const wstring& str, RecFormat fmt) const
@@ -402,35 +669,83 @@ PRowCol_pair ChessManual::__getPRowCol_pair(const wstring& str, RecFormat fmt) c
             make_pair(PieceManager::getRowFromICCSChar(str.at(3)), PieceManager::getColFromICCSChar(str.at(2))));
 }
 
-void ChessManual::__setMoveZhStrAndNums()
+void ChessManual::__setMoveNums()
 {
-    function<void(const SMove&)>
-        __setZhStrAndNums = [&](const SMove& move) {
-            ++movCount_;
-            maxCol_ = max(maxCol_, move->otherNo());
-            maxRow_ = max(maxRow_, move->nextNo());
-            move->setCC_ColNo(maxCol_); // # 本着在视图中的列数
-            if (!move->remark().empty()) {
-                ++remCount_;
-                remLenMax_ = max(remLenMax_, static_cast<int>(move->remark().size()));
-            }
-            move->setZhStr(board_->getZHStr(move->getPRowCol_pair()));
+    auto __setNums = [&](MoveIndex move, bool) {
+        Move& amove{ moves_[move] };
+        ++movCount_;
+        maxCol_ = max(maxCol_, amove.otherNo());
+        maxRow_ = max(maxRow_, amove.nextNo());
+        amove.setCC_ColNo(maxCol_); // # 本着在视图中的列数
+        if (!__remark(move).empty()) {
+            ++remCount_;
+            remLenMax_ = max(remLenMax_, static_cast<int>(__remark(move).size()));
+        }
+    };
 
-            //wcout << move->zh() << L'\n' << board_->toString() << L'\n' << endl;
-            __done(move);
-            if (move->next())
-                __setZhStrAndNums(move->next());
-            __undo(move);
+    movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __setNums,
+            [](MoveIndex) {}, [&](MoveIndex) { ++maxCol_; });
+}
 
-            if (move->other()) {
-                ++maxCol_;
-                __setZhStrAndNums(move->other());
-            }
-        };
+void ChessManual::__setMoveZhStrs()
+{
+    auto __setZhStr = [&](MoveIndex move, bool) {
+        Move& amove{ moves_[move] };
+        amove.setZhStr(board_->getZHStr(amove.getPRowCol_pair()));
 
-    movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
-    if (rootMove_->next())
-        __setZhStrAndNums(rootMove_->next()); // 驱动函数
+        //wcout << amove.zh() << L'\n' << board_->toString() << L'\n' << endl;
+        __done(move);
+    };
+
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __setZhStr,
+            [&](MoveIndex move) { __undo(move); }, [](MoveIndex) {});
+    hasZhStr_ = true;
+}
+
+void ChessManual::__requireZhStrs()
+{
+    if (hasZhStr_)
+        return;
+    MoveIndex curMove{ currentMove_ };
+    __backTo(rootMove_); // 须从初始局面逐着推演
+    __setMoveZhStrs();
+    for (auto move : __getPrevMoves(curMove))
+        __done(move);
+    currentMove_ = curMove;
+}
+
+void ChessManual::__setMoveHashKeys()
+{
+    auto __setHashKey = [&](MoveIndex move, bool) {
+        // 各格式读取后均经此推演，起止位置无效或起点无棋子的着法在此拒绝
+        MoveCode moveCode{ moves_[move].moveCode() };
+        if (moveCode.findex() >= SEATNUM || moveCode.tindex() >= SEATNUM || moveCode.findex() == moveCode.tindex()
+            || !board_->getPiece(moveCode.findex()))
+            throw runtime_error("棋谱着法错误：起止位置无效或起点无棋子");
+        __done(move);
+        moves_[move].setHashKey(board_->hashKey());
+    };
+
+    moves_[rootMove_].setHashKey(board_->hashKey());
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __setHashKey,
+            [&](MoveIndex move) { __undo(move); }, [](MoveIndex) {});
+    hasHashKey_ = true;
+}
+
+void ChessManual::__requireHashKeys()
+{
+    if (hasHashKey_)
+        return;
+    MoveIndex curMove{ currentMove_ };
+    __backTo(rootMove_);
+    __setMoveHashKeys();
+    for (auto move : __getPrevMoves(curMove))
+        __done(move);
+    currentMove_ = curMove;
 }
 
 const wstring ChessManual::__moveInfo() const
@@ -441,88 +756,48 @@ const wstring ChessManual::__moveInfo() const
     return wos.str();
 }
 
-void ChessManual::__readXQF(istream& is)
-{
-    char Signature[3]{}, Version{}, headKeyMask{}, ProductId[4]{}, //文件标记'XQ'=$5158/版本/加密掩码/ProductId[4], 产品(厂商的产品号)
-        headKeyOrA{}, headKeyOrB{}, headKeyOrC{}, headKeyOrD{},
-        headKeysSum{}, headKeyXY{}, headKeyXYf{}, headKeyXYt{}, // 加密的钥匙和/棋子布局位置钥匙/棋谱起点钥匙/棋谱终点钥匙
-        headQiziXY[PIECENUM]{}, // 32个棋子的原始位置
-        // 用单字节坐标表示, 将字节变为十进制, 十位数为X(0-8)个位数为Y(0-9),
-        // 棋盘的左下角为原点(0, 0). 32个棋子的位置从1到32依次为:
-        // 红: 车马相士帅士相马车炮炮兵兵兵兵兵 (位置从右到左, 从下到上)
-        // 黑: 车马象士将士象马车炮炮卒卒卒卒卒 (位置从右到左, 从下到上)PlayStepNo[2],
-        PlayStepNo[2]{},
-        headWhoPlay{}, headPlayResult{}, PlayNodes[4]{}, PTreePos[4]{}, Reserved1[4]{},
-        // 该谁下 0-红先, 1-黑先/最终结果 0-未知, 1-红胜 2-黑胜, 3-和棋
-        headCodeA_H[16]{}, TitleA[65]{}, TitleB[65]{}, //对局类型(开,中,残等)
-        Event[65]{}, Date[17]{}, Site[17]{}, Red[17]{}, Black[17]{},
-        Opening[65]{}, Redtime[17]{}, Blktime[17]{}, Reservedh[33]{},
-        RMKWriter[17]{}, Author[17]{}; //, Other[528]{}; // 棋谱评论员/文件的作者
-
-    is.read(Signature, 2).get(Version).get(headKeyMask).read(ProductId, 4) // = 8 bytes
-        .get(headKeyOrA)
-        .get(headKeyOrB)
-        .get(headKeyOrC)
-        .get(headKeyOrD)
-        .get(headKeysSum)
-        .get(headKeyXY)
-        .get(headKeyXYf)
-        .get(headKeyXYt) // = 16 bytes
-        .read(headQiziXY, PIECENUM) // = 48 bytes
-        .read(PlayStepNo, 2)
-        .get(headWhoPlay)
-        .get(headPlayResult)
-        .read(PlayNodes, 4)
-        .read(PTreePos, 4)
-        .read(Reserved1, 4) // = 64 bytes
-        .read(headCodeA_H, 16)
-        .read(TitleA, 64)
-        .read(TitleB, 64)
-        .read(Event, 64)
-        .read(Date, 16)
-        .read(Site, 16)
-        .read(Red, 16)
-        .read(Black, 16)
-        .read(Opening, 64)
-        .read(Redtime, 16)
-        .read(Blktime, 16)
-        .read(Reservedh, 32)
-        .read(RMKWriter, 16)
-        .read(Author, 16);
-
-    assert(Signature[0] == 0x58 || Signature[1] == 0x51);
-    assert((headKeysSum + headKeyXY + headKeyXYf + headKeyXYt) % 256 == 0); // L" 检查密码校验和不对，不等于0。\n";
-    assert(Version <= 18); // L" 这是一个高版本的XQF文件，您需要更高版本的XQStudio来读取这个文件。\n";
-
-    unsigned char KeyXY{}, KeyXYf{}, KeyXYt{}, F32Keys[PIECENUM], *head_QiziXY{ (unsigned char*)headQiziXY };
-    int KeyRMKSize{ 0 };
-    if (Version <= 10) { // version <= 10 兼容1.0以前的版本
-        KeyRMKSize = KeyXYf = KeyXYt = 0;
-    } else {
-        function<unsigned char(unsigned char, unsigned char)> __calkey = [](unsigned char bKey, unsigned char cKey) {
-            return (((((bKey * bKey) * 3 + 9) * 3 + 8) * 2 + 1) * 3 + 8) * cKey; // % 256; // 保持为<256
-        };
-        KeyXY = __calkey(headKeyXY, headKeyXY);
-        KeyXYf = __calkey(headKeyXYf, KeyXY);
-        KeyXYt = __calkey(headKeyXYt, KeyXYf);
-        KeyRMKSize = (static_cast<unsigned char>(headKeysSum) * 256 + static_cast<unsigned char>(headKeyXY)) % 32000 + 767; // % 65536
-        if (Version >= 12) { // 棋子位置循环移动
-            vector<unsigned char> Qixy(begin(headQiziXY), end(headQiziXY)); // 数组不能拷贝
+void ChessManual::__readXQF(string& bytes)
+{
+    if (bytes.size() < XQF_HeadSize + 4)
+        throw runtime_error("XQF文件不完整");
+    const char* head{ bytes.data() };
+    int Version{ static_cast<unsigned char>(head[XQF_Version]) };
+    unsigned char headPlayResult = head[XQF_PlayResult], headCodeA_H = head[XQF_CodeA_H];
+
+    if (head[0] != 0x58 || head[1] != 0x51)
+        throw runtime_error("XQF文件标记错误");
+    if (Version == 0 || Version > 18)
+        throw runtime_error("XQF文件版本不支持"); // 高版本需更高版本的XQStudio读取
+    unsigned keysSum{ 0 };
+    for (int i = 0; i != 4; ++i)
+        keysSum += static_cast<unsigned char>(head[XQF_KeysSum + i]);
+    if (Version > 10 && keysSum % 256 != 0) // 版本11起加密，钥匙和须为0
+        throw runtime_error("XQF文件密码校验和错误");
+
+    // 32个棋子的原始位置, 用单字节坐标表示, 将字节变为十进制, 十位数为X(0-8)个位数为Y(0-9),
+    // 棋盘的左下角为原点(0, 0). 32个棋子的位置从1到32依次为:
+    // 红: 车马相士帅士相马车炮炮兵兵兵兵兵 (位置从右到左, 从下到上)
+    // 黑: 车马象士将士象马车炮炮卒卒卒卒卒 (位置从右到左, 从下到上)
+    XQFKeys keys{}; // version <= 10 兼容1.0以前的版本，不加密，密钥均为0
+    unsigned char head_QiziXY[PIECENUM]{};
+    copy(head + XQF_QiziXY, head + XQF_QiziXY + PIECENUM, head_QiziXY);
+    if (Version > 10) {
+        keys = getXQFKeys(head);
+        if (Version >= 12) // 棋子位置循环移动
             for (int i = 0; i != PIECENUM; ++i)
-                head_QiziXY[(i + KeyXY + 1) % PIECENUM] = Qixy[i];
-        }
+                head_QiziXY[(i + keys.KeyXY + 1) % PIECENUM] = head[XQF_QiziXY + i];
         for (int i = 0; i != PIECENUM; ++i)
-            head_QiziXY[i] -= KeyXY; // 保持为8位无符号整数，<256
+            head_QiziXY[i] -= keys.KeyXY; // 保持为8位无符号整数，<256
+
+        // '字节解密'：文件头之后的全部字节按所在位置循环减去密钥，逐块处理便于向量化
+        unsigned char* data{ reinterpret_cast<unsigned char*>(&bytes[0]) };
+        size_t pos{ XQF_HeadSize }, size{ bytes.size() };
+        for (; pos + PIECENUM <= size; pos += PIECENUM)
+            for (int i = 0; i != PIECENUM; ++i)
+                data[pos + i] -= keys.F32Keys[i];
+        for (; pos < size; ++pos)
+            data[pos] -= keys.F32Keys[pos % PIECENUM];
     }
-    int KeyBytes[4]{
-        (headKeysSum & headKeyMask) | headKeyOrA,
-        (headKeyXY & headKeyMask) | headKeyOrB,
-        (headKeyXYf & headKeyMask) | headKeyOrC,
-        (headKeyXYt & headKeyMask) | headKeyOrD
-    };
-    const string copyright{ "[(C) Copyright Mr. Dong Shiwei.]" };
-    for (int i = 0; i != PIECENUM; ++i)
-        F32Keys[i] = copyright[i] & KeyBytes[i % 4]; // ord(c)
 
     // 取得棋子字符串
     wstring pieceChars(90, PieceManager::nullChar());
@@ -533,52 +808,43 @@ void ChessManual::__readXQF(istream& is)
             pieceChars[xy % 10 * 9 + xy / 10] = pieChars[i];
     }
 
-    //wcout << __LINE__ << L":" << pieceChars << endl;
+    // 该谁下 0-红先, 1-黑先/最终结果 0-未知, 1-红胜 2-黑胜, 3-和棋；对局类型(开,中,残等)
     info_ = map<wstring, wstring>{
         { L"Version", to_wstring(Version) },
         { L"Result", (map<unsigned char, wstring>{ { 0, L"未知" }, { 1, L"红胜" }, { 2, L"黑胜" }, { 3, L"和棋" } })[headPlayResult] },
-        { L"PlayType", (map<unsigned char, wstring>{ { 0, L"全局" }, { 1, L"开局" }, { 2, L"中局" }, { 3, L"残局" } })[headCodeA_H[0]] },
-        { L"TitleA", Tools::s2ws(TitleA) },
-        { L"Event", Tools::s2ws(Event) },
-        { L"Date", Tools::s2ws(Date) },
-        { L"Site", Tools::s2ws(Site) },
-        { L"Red", Tools::s2ws(Red) },
-        { L"Black", Tools::s2ws(Black) },
-        { L"Opening", Tools::s2ws(Opening) },
-        { L"RMKWriter", Tools::s2ws(RMKWriter) },
-        { L"Author", Tools::s2ws(Author) },
+        { L"PlayType", (map<unsigned char, wstring>{ { 0, L"全局" }, { 1, L"开局" }, { 2, L"中局" }, { 3, L"残局" } })[headCodeA_H] },
         { FENKey, pieCharsToFEN(pieceChars) } // 可能存在不是红棋先走的情况？在readMove后再更新一下！
     };
-
-    //wcout << __LINE__ << L":" << pieceChars << endl;
+    for (auto& field : XQFTextFields) { // 首字节为长度的定长字段（ShortString）；不合长度的按以空字符结尾处理
+        const char* str{ head + field.offset };
+        size_t len{ static_cast<unsigned char>(str[0]) };
+        if (len < static_cast<size_t>(field.size) && find(str + 1, str + 1 + len, '\0') == str + 1 + len)
+            info_[field.key] = Tools::gbk2ws(str + 1, len);
+        else
+            info_[field.key] = Tools::gbk2ws(string(str, find(str, str + field.size, '\0')));
+    }
     __setBoardFromInfo();
 
-    function<unsigned char(unsigned char, unsigned char)>
-        __sub = [](unsigned char a, unsigned char b) {
-            return a - b;
-        }; // 保持为<256
-
-    auto __readBytes = [&](char* bytes, int size) {
-        auto pos = is.tellg();
-        is.read(bytes, size);
-        if (Version > 10) // '字节解密'
-            for (int i = 0; i != size; ++i)
-                bytes[i] = __sub(bytes[i], F32Keys[(i + pos) % 32]);
+    // 着法、注释均已解密，直接从缓冲区取值
+    size_t pos{ XQF_HeadSize };
+    auto __getBytes = [&](size_t size) {
+        if (pos + size > bytes.size())
+            throw runtime_error("XQF文件不完整");
+        const char* data{ bytes.data() + pos };
+        pos += size;
+        return data;
     };
-
-    char data[4]{}, &frc{ data[0] }, &trc{ data[1] }, &tag{ data[2] };
-
     auto __getRemarksize = [&]() {
-        char clen[4]{};
-        __readBytes(clen, 4);
-        return *(int*)clen - KeyRMKSize;
+        int size{};
+        memcpy(&size, __getBytes(sizeof(int)), sizeof(int));
+        return size - keys.KeyRMKSize;
     };
 
-    //function<wstring()>
+    char frc{}, trc{}, tag{};
     auto __readDataAndGetRemark = [&]() {
-        __readBytes(data, 4);
+        const char* data{ __getBytes(4) };
+        frc = data[0], trc = data[1], tag = data[2];
         int RemarkSize{};
-        wstring wstr{};
         if (Version <= 10) {
             tag = ((tag & 0xF0) ? 0x80 : 0) | ((tag & 0x0F) ? 0x40 : 0);
             RemarkSize = __getRemarksize();
@@ -587,76 +853,235 @@ void ChessManual::__readXQF(istream& is)
             if (tag & 0x20)
                 RemarkSize = __getRemarksize();
         }
-        if (RemarkSize > 0) { // # 如果有注解
-            char* rem = new char[RemarkSize + 1]();
-            __readBytes(rem, RemarkSize);
-            wstr = Tools::s2ws(rem);
-            delete[] rem;
-        }
-        return wstr;
+        if (RemarkSize <= 0) // # 如果有注解
+            return wstring{};
+        const char* rem{ __getBytes(RemarkSize) };
+        return Tools::gbk2ws(string(rem, find(rem, rem + RemarkSize, '\0')));
     };
 
-    function<void(SMove&, bool)>
-        __readMove = [&](SMove& move, bool isOther) {
-            auto remark = __readDataAndGetRemark();
-            //# 一步棋的起点和终点有简单的加密计算，读入时需要还原
-            int fcolrow = __sub(frc, 0X18 + KeyXYf), tcolrow = __sub(trc, 0X20 + KeyXYt);
-            assert(fcolrow <= 89 && tcolrow <= 89);
-
-            auto prowcol_pair = make_pair(make_pair(fcolrow % 10, fcolrow / 10), make_pair(tcolrow % 10, tcolrow / 10));
-            auto& newMove = (isOther ? addOtherMove(move, prowcol_pair, remark) : addNextMove(move, prowcol_pair, remark));
-
-            char ntag{ tag };
-            if (ntag & 0x80) //# 有左子树
-                __readMove(newMove, false);
-            if (ntag & 0x40) // # 有右子树
-                __readMove(newMove, true);
-        };
+    auto __readMove = [&](MoveIndex move, bool) {
+        __setRemark(move, __readDataAndGetRemark());
+        //# 一步棋的起点和终点有简单的加密计算，读入时需要还原
+        int fcolrow = static_cast<unsigned char>(frc - (0X18 + keys.KeyXYf)),
+            tcolrow = static_cast<unsigned char>(trc - (0X20 + keys.KeyXYt));
+        if (fcolrow > 89 || tcolrow > 89)
+            throw runtime_error("XQF文件着法位置错误");
+        moves_[move].setPRowCol_pair(make_pair(make_pair(fcolrow % 10, fcolrow / 10), make_pair(tcolrow % 10, tcolrow / 10)));
+
+        char ntag{ tag };
+        if (ntag & 0x80) //# 有左子树
+            __addMove(move, false);
+        if (ntag & 0x40) // # 有右子树
+            __addMove(move, true);
+    };
 
-    is.seekg(1024);
-    rootMove_->setRemark(__readDataAndGetRemark());
+    __setRemark(rootMove_, __readDataAndGetRemark());
     char rtag{ tag };
-    //wcout << __LINE__ << L":" << rootMove_->remark() << endl;
+    //wcout << __LINE__ << L":" << __remark(rootMove_) << endl;
 
     if (rtag & 0x80) //# 有左子树
-        __readMove(rootMove_, false);
+        __traverse(__addMove(rootMove_, false), false, __readMove);
 }
 
-void ChessManual::__readBIN(istream& is)
+void ChessManual::__writeXQF(ostream& os) const
 {
-    char len[sizeof(int)]{};
-    function<wstring()> __readWstring = [&]() {
-        is.read(len, sizeof(int));
-        int length{ *(int*)len };
-        wstring wstr{};
-        char* rem = new char[length + 1]();
-        is.read(rem, length);
-        wstr = Tools::s2ws(rem);
-        delete[] rem;
+    string bytes(XQF_HeadSize, '\0');
+    char* head{ &bytes[0] };
+    head[XQF_Signature] = 'X';
+    head[XQF_Signature + 1] = 'Q';
+    head[XQF_Version] = 18;
+    // 固定的钥匙：钥匙和使四个钥匙之和为256，掩码取全部位
+    head[XQF_KeyMask] = '\xFF';
+    head[XQF_KeysSum] = 0x63;
+    head[XQF_KeysSum + 1] = 0x21;
+    head[XQF_KeysSum + 2] = 0x35;
+    head[XQF_KeysSum + 3] = 0x47;
+    XQFKeys keys{ getXQFKeys(head) };
+
+    // 按QiziXY设定的棋子顺序，依次为各棋子分配位置，无此棋子则为空位
+    const wstring pieChars{ L"RNBAKABNRCCPPPPPrnbakabnrccppppp" }, FENplus{ info_.at(FENKey) };
+    const wstring pieceChars{ FENTopieChars(FENplusToFEN(FENplus)) };
+    unsigned char head_QiziXY[PIECENUM];
+    fill(begin(head_QiziXY), end(head_QiziXY), 0xFF);
+    for (int index = 0; index != static_cast<int>(pieceChars.size()); ++index) {
+        for (size_t i = pieChars.find(pieceChars[index]); i != wstring::npos; i = pieChars.find(pieceChars[index], i + 1))
+            if (head_QiziXY[i] == 0xFF) {
+                head_QiziXY[i] = index % 9 * 10 + index / 9;
+                break;
+            }
+    }
+    for (int i = 0; i != PIECENUM; ++i) // 读取时先循环移动，再减去KeyXY
+        head[XQF_QiziXY + i] = head_QiziXY[(i + keys.KeyXY + 1) % PIECENUM] + keys.KeyXY;
+
+    head[XQF_WhoPlay] = FENplusToColor(FENplus) == PieceColor::BLACK;
+    auto __getInfoNo = [&](const wchar_t* key, const vector<wstring>& values) {
+        auto kv = info_.find(key);
+        int no = kv == info_.end() ? 0 : find(values.begin(), values.end(), kv->second) - values.begin();
+        return no < static_cast<int>(values.size()) ? no : 0;
+    };
+    head[XQF_PlayResult] = __getInfoNo(L"Result", { L"未知", L"红胜", L"黑胜", L"和棋" });
+    head[XQF_CodeA_H] = __getInfoNo(L"PlayType", { L"全局", L"开局", L"中局", L"残局" });
+    for (auto& field : XQFTextFields) { // 长度字节 + GBK文本，超长则在完整字符处截断
+        auto kv = info_.find(field.key);
+        if (kv != info_.end()) {
+            string str{ Tools::ws2gbk(kv->second) };
+            size_t len{ 0 };
+            for (size_t charLen; len < str.size(); len += charLen) {
+                charLen = static_cast<unsigned char>(str[len]) < 0x80 ? 1 : 2;
+                if (len + charLen > static_cast<size_t>(field.size - 1))
+                    break;
+            }
+            head[field.offset] = static_cast<char>(len);
+            copy_n(str.begin(), len, head + field.offset + 1);
+        }
+    }
+
+    // 着法记录：起止位置、标记及注释，写完后整体加密
+    auto __writeDataAndRemark = [&](int fcolrow, int tcolrow, char tag, const wstring& remark) {
+        if (!remark.empty())
+            tag |= 0x20;
+        bytes += static_cast<char>(fcolrow + 0X18 + keys.KeyXYf);
+        bytes += static_cast<char>(tcolrow + 0X20 + keys.KeyXYt);
+        bytes += tag;
+        bytes += '\0';
+        if (tag & 0x20) {
+            string rem{ Tools::ws2gbk(remark) };
+            int size = rem.size() + keys.KeyRMKSize;
+            bytes.append(reinterpret_cast<const char*>(&size), sizeof(int));
+            bytes += rem;
+        }
+    };
+    auto __getColRow = [](RowCol_pair rowcol_pair) { return rowcol_pair.second * 10 + rowcol_pair.first; };
+    auto __writeMove = [&](MoveIndex move, bool) {
+        const Move& amove{ moves_[move] };
+        auto prowcol_pair = amove.getPRowCol_pair();
+        __writeDataAndRemark(__getColRow(prowcol_pair.first), __getColRow(prowcol_pair.second),
+            (amove.next() != NullMove ? 0x80 : 0) | (amove.other() != NullMove ? 0x40 : 0), __remark(move));
+    };
+
+    __writeDataAndRemark(0, 0, moves_[rootMove_].next() != NullMove ? 0x80 : 0, __remark(rootMove_));
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __writeMove);
+
+    unsigned char* data{ reinterpret_cast<unsigned char*>(&bytes[0]) };
+    for (size_t pos = XQF_HeadSize; pos < bytes.size(); ++pos) // '字节加密'
+        data[pos] += keys.F32Keys[pos % PIECENUM];
+    os.write(bytes.data(), bytes.size());
+}
+
+void ChessManual::__readBIN(const char* data, size_t size)
+{
+    if (size < BINMagicSize || memcmp(data, BINMagic, BINMagicSize) != 0)
+        return __readBIN_v1(data, size);
+    if (size < BINMagicSize + 1 + BINCheckSize)
+        throw runtime_error("BIN文件不完整");
+    if (data[BINMagicSize] != BINVersion)
+        throw runtime_error("BIN文件版本不支持");
+
+    size_t bodySize{ size - BINCheckSize }, pos{ BINMagicSize + 1 };
+    if (getCRC32(data, bodySize) != getUInt(data + bodySize, BINCheckSize))
+        throw runtime_error("BIN文件校验错误");
+
+    auto __getBytes = [&](size_t len) {
+        if (len > bodySize - pos)
+            throw runtime_error("BIN文件不完整");
+        const char* bytes{ data + pos };
+        pos += len;
+        return bytes;
+    };
+    auto __getVarint = [&]() {
+        uint32_t value{ 0 };
+        for (int shift = 0; shift < 35; shift += 7) {
+            unsigned char byte = *__getBytes(1);
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw runtime_error("BIN文件格式错误");
+    };
+    auto __getWstring = [&]() {
+        uint32_t len{ __getVarint() };
+        const char* str{ __getBytes(len) };
+        return Tools::utf82ws(str, len);
+    };
+
+    uint32_t nodeCount{ __getVarint() };
+    for (uint32_t infoCount{ __getVarint() }; infoCount > 0; --infoCount) {
+        wstring key{ __getWstring() };
+        info_[key] = __getWstring();
+    }
+    __setBoardFromInfo();
+    __setRemark(rootMove_, __getWstring());
+    const unsigned char* nodes{ reinterpret_cast<const unsigned char*>(__getBytes(size_t{ nodeCount } * 2)) };
+    uint32_t remarkCount{ __getVarint() };
+    if (remarkCount > (bodySize - pos) / 2) // 每条注释至少有序号差及长度各1字节
+        throw runtime_error("BIN文件不完整");
+    moves_.reserve(nodeCount + 1);
+    remarks_.reserve(remarkCount + 1);
+
+    // 注释按节点先序号的增量排列，随遍历依次读取
+    uint32_t nodeNo{ 0 }, remarkNodeNo{ remarkCount > 0 ? __getVarint() : nodeCount };
+    auto __readMove = [&](MoveIndex move, bool) {
+        if (nodeNo == nodeCount)
+            throw runtime_error("BIN文件格式错误");
+        int code{ nodes[nodeNo * 2] | nodes[nodeNo * 2 + 1] << 8 };
+        MoveCode moveCode{ MoveCode::fromCode(code & BINCodeMask) };
+        if (moveCode.findex() >= SEATNUM || moveCode.tindex() >= SEATNUM)
+            throw runtime_error("BIN文件格式错误");
+        moves_[move].setMoveCode(moveCode);
+        if (nodeNo == remarkNodeNo) {
+            __setRemark(move, __getWstring());
+            remarkNodeNo = --remarkCount > 0 ? remarkNodeNo + __getVarint() : nodeCount;
+        }
+        ++nodeNo;
+
+        if (code & BINNextFlag)
+            __addMove(move, false);
+        if (code & BINOtherFlag)
+            __addMove(move, true);
+    };
+    if (nodeCount > 0)
+        __traverse(__addMove(rootMove_, false), false, __readMove);
+    if (nodeNo != nodeCount || remarkCount > 0 || pos != bodySize)
+        throw runtime_error("BIN文件格式错误");
+}
+
+void ChessManual::__readBIN_v1(const char* data, size_t size)
+{
+    size_t pos{ 0 };
+    auto __getBytes = [&](size_t len) {
+        if (len > size - pos)
+            throw runtime_error("BIN文件不完整");
+        const char* bytes{ data + pos };
+        pos += len;
+        return bytes;
+    };
+    auto __readWstring = [&]() {
+        int length{};
+        memcpy(&length, __getBytes(sizeof(int)), sizeof(int));
+        const char* str{ __getBytes(max(length, 0)) };
+        size_t len{ strnlen(str, max(length, 0)) };
+        wstring wstr{}; // 旧版本按写入时的区域设置编码，UTF-8或GBK
+        Tools::decode(str, len, Tools::detectCharset(str, len), wstr);
         return wstr;
     };
 
-    char frowcol{}, trowcol{};
-    function<void(SMove&, bool)>
-        __readMove = [&](SMove& move, bool isOther) {
-            char tag{};
-            is.get(frowcol).get(trowcol).get(tag);
-            auto prowcol_pair = make_pair(SeatManager::getRowCol_pair(frowcol), SeatManager::getRowCol_pair(trowcol));
-            auto remark = (tag & 0x20) ? __readWstring() : wstring{};
-            auto& newMove = (isOther ? addOtherMove(move, prowcol_pair, remark) : addNextMove(move, prowcol_pair, remark));
-
-            if (tag & 0x80)
-                __readMove(newMove, false);
-            if (tag & 0x40)
-                __readMove(newMove, true);
-            return move;
-        };
+    auto __readMove = [&](MoveIndex move, bool) {
+        const char* record{ __getBytes(3) };
+        char tag{ record[2] };
+        moves_[move].setPRowCol_pair(make_pair(SeatManager::getRowCol_pair(record[0]), SeatManager::getRowCol_pair(record[1])));
+        if (tag & 0x20)
+            __setRemark(move, __readWstring());
+
+        if (tag & 0x80)
+            __addMove(move, false);
+        if (tag & 0x40)
+            __addMove(move, true);
+    };
 
-    char atag{};
-    is.get(atag);
+    char atag{ size > 0 ? *__getBytes(1) : '\0' };
     if (atag & 0x80) {
-        char len{};
-        is.get(len);
+        char len{ *__getBytes(1) };
         wstring key{}, value{};
         for (int i = 0; i < len; ++i) {
             key = __readWstring();
@@ -667,172 +1092,390 @@ void ChessManual::__readBIN(istream& is)
     __setBoardFromInfo();
 
     if (atag & 0x40)
-        rootMove_->setRemark(__readWstring());
+        __setRemark(rootMove_, __readWstring());
     if (atag & 0x20)
-        __readMove(rootMove_, false);
+        __traverse(__addMove(rootMove_, false), false, __readMove);
 }
 
-void ChessManual::__writeBIN(ostream& os) const
+void ChessManual::__writeBIN(string& bytes) const
 {
-    auto __writeWstring = [&](const wstring& wstr) {
-        string str{ Tools::ws2s(wstr) };
-        int len = str.size();
-        os.write((char*)&len, sizeof(int)).write(str.c_str(), len);
+    string nodes{}, remarks{};
+    uint32_t nodeCount{ 0 }, remarkCount{ 0 }, remarkNodeNo{ 0 };
+    nodes.reserve(moves_.size() * 2);
+    auto __writeMove = [&](MoveIndex move, bool) {
+        const Move& amove{ moves_[move] };
+        int code{ amove.moveCode().code() | (amove.next() != NullMove ? BINNextFlag : 0)
+            | (amove.other() != NullMove ? BINOtherFlag : 0) };
+        nodes.push_back(static_cast<char>(code));
+        nodes.push_back(static_cast<char>(code >> 8));
+        if (!__remark(move).empty()) {
+            appendVarint(remarks, nodeCount - remarkNodeNo);
+            appendUTF8(remarks, __remark(move));
+            remarkNodeNo = nodeCount;
+            ++remarkCount;
+        }
+        ++nodeCount;
     };
-    function<void(const SMove&)>
-        __writeMove = [&](const SMove& move) {
-            char tag = ((move->next() ? 0x80 : 0x00)
-                | (move->other() ? 0x40 : 0x00)
-                | (!move->remark().empty() ? 0x20 : 0x00));
-            os.put(move->frowcol()).put(move->trowcol()).put(tag);
-            if (tag & 0x20)
-                __writeWstring(move->remark());
-            if (tag & 0x80)
-                __writeMove(move->next());
-            if (tag & 0x40)
-                __writeMove(move->other());
-        };
-
-    char tag = ((!info_.empty() ? 0x80 : 0x00)
-        | (!rootMove_->remark().empty() ? 0x40 : 0x00)
-        | (rootMove_->next() ? 0x20 : 0x00));
-    os.put(tag);
-    if (tag & 0x80) {
-        int infoLen = info_.size();
-        os.put(infoLen);
-        for_each(info_.begin(), info_.end(),
-            [&](const pair<wstring, wstring>& kv) {
-                __writeWstring(kv.first);
-                __writeWstring(kv.second);
-            });
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __writeMove);
+
+    bytes.assign(BINMagic, BINMagicSize);
+    bytes.push_back(BINVersion);
+    appendVarint(bytes, nodeCount);
+    appendVarint(bytes, info_.size());
+    for (auto& kv : info_) {
+        appendUTF8(bytes, kv.first);
+        appendUTF8(bytes, kv.second);
     }
-    if (tag & 0x40)
-        __writeWstring(rootMove_->remark());
-    if (tag & 0x20)
-        __writeMove(rootMove_->next());
+    appendUTF8(bytes, __remark(rootMove_));
+    bytes.append(nodes);
+    appendVarint(bytes, remarkCount);
+    bytes.append(remarks);
+    appendUInt(bytes, getCRC32(bytes.data(), bytes.size()), BINCheckSize);
 }
 
-void ChessManual::__readJSON(istream& is)
+void ChessManual::__readJSON(const char* data, size_t size)
 {
-    Json::CharReaderBuilder builder;
-    Json::Value root;
-    JSONCPP_STRING errs;
-    if (!parseFromStream(builder, is, &root, &errs))
-        return;
+    // 旧版本在GBK区域设置下写入的文件，文本为GBK
+    const Tools::Charset charset{ Tools::detectCharset(data, size) };
+    size_t pos{ 0 };
+    auto __error = []() { throw runtime_error("JSON文件格式错误"); };
+    auto __peek = [&]() {
+        while (pos < size && isspace(static_cast<unsigned char>(data[pos])))
+            ++pos;
+        return pos < size ? data[pos] : '\0';
+    };
+    auto __expect = [&](char ch) {
+        if (__peek() != ch)
+            __error();
+        ++pos;
+    };
+    auto __getHex4 = [&]() {
+        if (size - pos < 4)
+            __error();
+        int code{ 0 };
+        for (int i = 0; i != 4; ++i) {
+            int ch{ tolower(static_cast<unsigned char>(data[pos++])) };
+            if (!isxdigit(ch))
+                __error();
+            code = code << 4 | (isdigit(ch) ? ch - '0' : ch - 'a' + 10);
+        }
+        return code;
+    };
+    auto __getString = [&]() {
+        __expect('"');
+        wstring wstr{};
+        while (true) {
+            size_t begin{ pos }; // 转义符之间的原样文本为完整的字符序列
+            while (pos < size && data[pos] != '"' && data[pos] != '\\')
+                ++pos;
+            Tools::decode(data + begin, pos - begin, charset, wstr);
+            if (pos == size)
+                __error();
+            if (data[pos++] == '"')
+                return wstr;
+            if (pos == size)
+                __error();
+            char ch{ data[pos++] };
+            switch (ch) {
+            case 'b':
+                wstr += L'\b';
+                break;
+            case 'f':
+                wstr += L'\f';
+                break;
+            case 'n':
+                wstr += L'\n';
+                break;
+            case 'r':
+                wstr += L'\r';
+                break;
+            case 't':
+                wstr += L'\t';
+                break;
+            case 'u': {
+                int code{ __getHex4() };
+                if (code >= 0xD800 && code < 0xDC00 && size - pos >= 6 && data[pos] == '\\' && data[pos + 1] == 'u') {
+                    pos += 2;
+                    int low{ __getHex4() };
+                    if (sizeof(wchar_t) > 2 && low >= 0xDC00 && low < 0xE000)
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    else {
+                        wstr += static_cast<wchar_t>(code);
+                        code = low;
+                    }
+                }
+                wstr += static_cast<wchar_t>(code);
+            } break;
+            default: // '"' '\\' '/'
+                wstr += static_cast<wchar_t>(ch);
+                break;
+            }
+        }
+    };
+    auto __getInt = [&]() {
+        bool negative{ __peek() == '-' };
+        if (negative)
+            ++pos;
+        if (pos == size || !isdigit(static_cast<unsigned char>(data[pos])))
+            __error();
+        int value{ 0 };
+        while (pos < size && isdigit(static_cast<unsigned char>(data[pos])) && value < 100000)
+            value = value * 10 + (data[pos++] - '0');
+        return negative ? -value : value;
+    };
+    // 跳过不使用的值：字符串、数值、字面量或嵌套的对象、数组
+    auto __skipValue = [&]() {
+        int depth{ 0 };
+        do {
+            char ch{ __peek() };
+            if (ch == '"')
+                __getString();
+            else if (ch == '{' || ch == '[')
+                ++depth, ++pos;
+            else if (ch == '}' || ch == ']')
+                --depth, ++pos;
+            else if (ch == ',' || ch == ':')
+                ++pos;
+            else if (ch && (isalnum(static_cast<unsigned char>(ch)) || ch == '-' || ch == '+' || ch == '.'))
+                while (pos < size && (isalnum(static_cast<unsigned char>(data[pos])) || strchr("-+.", data[pos])))
+                    ++pos;
+            else
+                __error();
+        } while (depth > 0);
+    };
 
-    Json::Value infoItem{ root["info"] };
-    for (auto& key : infoItem.getMemberNames())
-        info_[Tools::s2ws(key)] = Tools::s2ws(infoItem[key].asString());
+    // 逐个成员读取，遇到着法对象即添加节点；以栈代替递归，嵌套深度不受限制
+    enum FrameKind { ROOTFRAME,
+        INFOFRAME,
+        MOVEFRAME };
+    struct Frame {
+        FrameKind kind;
+        MoveIndex move;
+        bool hasMember;
+        int frowcol, trowcol;
+    };
+    auto __isRowCol = [](int rowcol) { return rowcol >= 0 && rowcol / 10 < BOARDROWNUM && rowcol % 10 < BOARDCOLNUM; };
+    vector<Frame> frames{};
+    __expect('{');
+    frames.push_back({ ROOTFRAME, rootMove_, false, 0, 0 });
+    while (!frames.empty()) {
+        if (__peek() == '}') {
+            ++pos;
+            Frame& frame{ frames.back() };
+            if (frame.kind == MOVEFRAME) {
+                if (!__isRowCol(frame.frowcol) || !__isRowCol(frame.trowcol))
+                    __error();
+                moves_[frame.move].setPRowCol_pair(make_pair(
+                    SeatManager::getRowCol_pair(frame.frowcol), SeatManager::getRowCol_pair(frame.trowcol)));
+            }
+            frames.pop_back();
+            continue;
+        }
+        if (frames.back().hasMember)
+            __expect(',');
+        frames.back().hasMember = true;
+        wstring key{ __getString() };
+        __expect(':');
+
+        Frame frame{ frames.back() };
+        char ch{ __peek() };
+        if (frame.kind == ROOTFRAME) {
+            if (key == L"info" && ch == '{') {
+                ++pos;
+                frames.push_back({ INFOFRAME, NullMove, false, 0, 0 });
+            } else if (key == L"remark" && ch == '"')
+                __setRemark(rootMove_, __getString());
+            else if (key == L"moves" && ch == '{') {
+                ++pos;
+                frames.push_back({ MOVEFRAME, __addMove(rootMove_, false), false, 0, 0 });
+            } else
+                __skipValue();
+        } else if (frame.kind == INFOFRAME) {
+            if (ch == '"')
+                info_[key] = __getString();
+            else
+                __skipValue();
+        } else {
+            if (key == L"f")
+                frames.back().frowcol = __getInt();
+            else if (key == L"t")
+                frames.back().trowcol = __getInt();
+            else if (key == L"r" && ch == '"')
+                __setRemark(frame.move, __getString());
+            else if ((key == L"n" || key == L"o") && ch == '{') {
+                ++pos;
+                frames.push_back({ MOVEFRAME, __addMove(frame.move, key == L"o"), false, 0, 0 });
+            } else
+                __skipValue();
+        }
+    }
     __setBoardFromInfo();
-
-    function<void(SMove&, bool, Json::Value&)>
-        __readMove = [&](SMove& move, bool isOther, Json::Value& item) {
-            int frowcol{ item["f"].asInt() }, trowcol{ item["t"].asInt() };
-            auto prowcol_pair = make_pair(SeatManager::getRowCol_pair(frowcol), SeatManager::getRowCol_pair(trowcol));
-            auto remark = (item.isMember("r") ? Tools::s2ws(item["r"].asString()) : wstring{});
-            auto& newMove = (isOther ? addOtherMove(move, prowcol_pair, remark) : addNextMove(move, prowcol_pair, remark));
-
-            if (item.isMember("n"))
-                __readMove(newMove, false, item["n"]);
-            if (item.isMember("o"))
-                __readMove(newMove, true, item["o"]);
-        };
-
-    rootMove_->setRemark(Tools::s2ws(root["remark"].asString()));
-    Json::Value rootItem{ root["moves"] };
-    if (!rootItem.isNull())
-        __readMove(rootMove_, false, rootItem);
 }
 
-void ChessManual::__writeJSON(ostream& os) const
+void ChessManual::__writeJSON(string& bytes) const
 {
-    Json::Value root{}, infoItem{};
-    Json::StreamWriterBuilder builder;
-    unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-    for_each(info_.begin(), info_.end(),
-        [&](const pair<wstring, wstring>& kv) {
-            infoItem[Tools::ws2s(kv.first)] = Tools::ws2s(kv.second);
-        });
-    root["info"] = infoItem;
-    function<Json::Value(const SMove&)>
-        __writeItem = [&](const SMove& move) {
-            Json::Value item{};
-            item["f"] = move->frowcol();
-            item["t"] = move->trowcol();
-            if (!move->remark().empty())
-                item["r"] = Tools::ws2s(move->remark());
-            if (move->next())
-                item["n"] = __writeItem(move->next());
-            if (move->other())
-                item["o"] = __writeItem(move->other());
-            return item;
-        };
-    root["remark"] = Tools::ws2s(rootMove_->remark());
-    if (rootMove_->next())
-        root["moves"] = __writeItem(rootMove_->next());
-    writer->write(root, &os);
+    auto __appendString = [&](const wstring& wstr) {
+        static constexpr char hexChars[]{ "0123456789abcdef" };
+        bytes += '"';
+        for (char ch : Tools::ws2utf8(wstr)) {
+            switch (ch) {
+            case '"':
+                bytes += "\\\"";
+                break;
+            case '\\':
+                bytes += "\\\\";
+                break;
+            case '\n':
+                bytes += "\\n";
+                break;
+            case '\r':
+                bytes += "\\r";
+                break;
+            case '\t':
+                bytes += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20)
+                    bytes.append("\\u00").append(1, hexChars[ch >> 4]).append(1, hexChars[ch & 0xF]);
+                else
+                    bytes += ch;
+                break;
+            }
+        }
+        bytes += '"';
+    };
+
+    // 紧凑格式：着法对象内先写本着，再嵌套下着"n"、变着"o"；变着链遍历完毕后依次闭合
+    auto __writeItem = [&](MoveIndex move, bool) {
+        const Move& amove{ moves_[move] };
+        bytes.append("{\"f\":").append(to_string(amove.frowcol())).append(",\"t\":").append(to_string(amove.trowcol()));
+        if (!__remark(move).empty()) {
+            bytes.append(",\"r\":");
+            __appendString(__remark(move));
+        }
+        if (amove.next() != NullMove)
+            bytes.append(",\"n\":");
+    };
+    auto __closeItem = [&](MoveIndex move) {
+        if (moves_[move].other() != NullMove)
+            return;
+        bytes += '}';
+        for (MoveIndex prev{ moves_[move].prev() }; moves_[prev].other() == move; move = prev, prev = moves_[move].prev())
+            bytes += '}';
+    };
+
+    bytes.assign("{\"info\":{");
+    for (auto& kv : info_) {
+        if (bytes.back() != '{')
+            bytes += ',';
+        __appendString(kv.first);
+        bytes += ':';
+        __appendString(kv.second);
+    }
+    bytes.append("},\"remark\":");
+    __appendString(__remark(rootMove_));
+    if (moves_[rootMove_].next() != NullMove) {
+        bytes.append(",\"moves\":");
+        __traverse(moves_[rootMove_].next(), false, __writeItem, __closeItem,
+            [&](MoveIndex) { bytes.append(",\"o\":"); });
+    }
+    bytes += '}';
 }
 
-void ChessManual::__readInfo_PGN(wistream& wis)
+void ChessManual::__readInfo_PGN(const wstring& text, size_t& pos)
 {
-    wstring line{};
-    wregex info{ LR"(\[(\w+)\s+\"([\s\S]*?)\"\])" };
-    while (getline(wis, line) && !line.empty()) { // 以空行为终止特征
-        wsmatch matches;
-        if (regex_match(line, matches, info))
-            info_[matches[1]] = matches[2];
+    // 每行格式：[键 "值"]，键为字母、数字或下划线
+    while (pos < text.size()) {
+        size_t end{ min(text.find(L'\n', pos), text.size()) };
+        wstring line{ text.substr(pos, end - pos) };
+        pos = end + 1;
+        if (!line.empty() && line.back() == L'\r')
+            line.pop_back();
+        if (line.empty()) // 以空行为终止特征
+            break;
+        size_t keyEnd{ 1 };
+        while (keyEnd < line.size() && (iswalnum(line[keyEnd]) || line[keyEnd] == L'_'))
+            ++keyEnd;
+        size_t valueBegin{ keyEnd };
+        while (valueBegin < line.size() && iswspace(line[valueBegin]))
+            ++valueBegin;
+        if (line.front() == L'[' && keyEnd > 1 && valueBegin > keyEnd && line.size() >= valueBegin + 3
+            && line[valueBegin] == L'"' && line.compare(line.size() - 2, 2, L"\"]") == 0)
+            info_[line.substr(1, keyEnd - 1)] = line.substr(valueBegin + 1, line.size() - valueBegin - 3);
     }
     __setBoardFromInfo();
 }
 
-void ChessManual::__readMove_PGN_ICCSZH(wistream& wis, RecFormat fmt)
+void ChessManual::__readMove_PGN_ICCSZH(const wstring& moveStr, size_t pos, RecFormat fmt)
 {
-    const wstring moveStr{ Tools::getWString(wis) };
     bool isPGN_ZH{ fmt == RecFormat::PGN_ZH };
-    wstring otherBeginStr{ LR"((\()?)" };
-    wstring boutStr{ LR"((\d+\.)?[\s...]*\b)" };
-    wstring ICCSZhStr{ LR"(([)"
-        + (isPGN_ZH ? PieceManager::getZhChars() : PieceManager::getICCSChars())
-        + LR"(]{4})\b)" };
-    wstring remarkStr{ LR"((?:\s*\{([\s\S]*?)\})?)" };
-    wstring otherEndStr{ LR"(\s*(\)+)?)" }; // 可能存在多个右括号
-    wregex moveReg{ otherBeginStr + boutStr + ICCSZhStr + remarkStr + otherEndStr },
-        remReg{ remarkStr + LR"(1\.)" };
-    wsmatch wsm{};
-    if (regex_search(moveStr, wsm, remReg))
-        rootMove_->setRemark(wsm.str(1));
-    SMove preMove{ rootMove_ }, move{ rootMove_ };
-    vector<SMove> preOtherMoves{};
-    for (wsregex_iterator wtiMove{ moveStr.begin(), moveStr.end(), moveReg }, wtiEnd{};
-         wtiMove != wtiEnd; ++wtiMove) {
-        if ((*wtiMove)[1].matched) {
-            preOtherMoves.push_back(preMove);
-            if (isPGN_ZH)
-                __undo(preMove);
-            move = addOtherMove(preMove, (*wtiMove)[3], fmt, (*wtiMove)[4]);
-        } else
-            move = addNextMove(preMove, (*wtiMove)[3], fmt, (*wtiMove)[4]);
-        if (isPGN_ZH)
-            __done(move); // 推进board的状态变化
-
-        if ((*wtiMove)[5].matched)
-            for (int num = (*wtiMove).length(5); num > 0; --num) {
-                preMove = preOtherMoves.back();
-                preOtherMoves.pop_back();
-                if (isPGN_ZH) {
-                    do {
-                        __undo(move);
-                    } while ((move = move->prev()) != preMove);
-                    __done(preMove);
-                }
+    const wstring moveChars{ isPGN_ZH ? PieceManager::getZhChars() : PieceManager::getICCSChars() };
+    auto __isMoveChar = [&](wchar_t ch) { return moveChars.find(ch) != wstring::npos; };
+
+    // 单遍扫描：回合序号、着法、{注释}、(变着)；注释属于其前的着法，首着之前的注释属于根节点
+    MoveIndex preMove{ rootMove_ }, move{ rootMove_ };
+    vector<MoveIndex> preOtherMoves{};
+    bool isOther{ false };
+    const size_t size{ moveStr.size() };
+    while (pos < size) {
+        wchar_t ch{ moveStr[pos] };
+        if (ch == L'{') {
+            size_t end{ moveStr.find(L'}', pos + 1) };
+            if (end == wstring::npos)
+                break;
+            __setRemark(move, moveStr.substr(pos + 1, end - pos - 1));
+            pos = end + 1;
+        } else if (ch == L'(') {
+            isOther = true;
+            ++pos;
+        } else if (ch == L')') {
+            ++pos;
+            if (preOtherMoves.empty())
+                continue;
+            preMove = preOtherMoves.back();
+            preOtherMoves.pop_back();
+            if (isPGN_ZH) {
+                do {
+                    __undo(move);
+                } while ((move = moves_[move].prev()) != preMove);
+                __done(preMove);
             }
-        else
-            preMove = move;
+            move = preMove;
+        } else if (ch >= L'0' && ch <= L'9') {
+            size_t end{ pos };
+            while (end < size && moveStr[end] >= L'0' && moveStr[end] <= L'9')
+                ++end;
+            if (end < size && moveStr[end] == L'.') // 回合序号
+                pos = end + 1;
+            else
+                pos = end;
+        } else if (__isMoveChar(ch)) {
+            size_t end{ pos + 1 };
+            while (end < size && __isMoveChar(moveStr[end]))
+                ++end;
+            if (end - pos == 4) {
+                wstring str{ moveStr.substr(pos, 4) };
+                if (isOther) {
+                    preOtherMoves.push_back(preMove);
+                    if (isPGN_ZH)
+                        __undo(preMove);
+                    move = addOtherMove(preMove, str, fmt, L"");
+                } else
+                    move = addNextMove(preMove, str, fmt, L"");
+                if (isPGN_ZH)
+                    __done(move); // 推进board的状态变化
+                preMove = move;
+                isOther = false;
+            }
+            pos = end;
+        } else
+            ++pos;
     }
     if (isPGN_ZH)
         while (move != rootMove_) {
             __undo(move);
-            move = move->prev();
+            move = moves_[move].prev();
         }
 }
 
@@ -848,123 +1491,381 @@ void ChessManual::__writeInfo_PGN(wostream& wos) const
 void ChessManual::__writeMove_PGN_ICCSZH(wostream& wos, RecFormat fmt) const
 {
     bool isPGN_ZH{ fmt == RecFormat::PGN_ZH };
-    auto __getRemarkStr = [&](const SMove& move) {
-        return (move->remark().empty()) ? L"" : (L" \n{" + move->remark() + L"}\n ");
+    auto __getRemarkStr = [&](MoveIndex move) {
+        return (__remark(move).empty()) ? L"" : (L" \n{" + __remark(move) + L"}\n ");
+    };
+    auto __writeMove = [&](MoveIndex move, bool isOther) {
+        const Move& amove{ moves_[move] };
+        wstring boutStr{ to_wstring((amove.nextNo() + 1) / 2) + L". " };
+        bool isEven{ amove.nextNo() % 2 == 0 };
+        wos << (isOther ? L"(" + boutStr + (isEven ? L"... " : L"")
+                        : (isEven ? wstring{ L" " } : boutStr))
+            << (isPGN_ZH ? amove.zh() : amove.iccs()) << L' '
+            << __getRemarkStr(move);
+    };
+    // 先写变着，变着子树写完后加右括号，再写下着
+    auto __closeOther = [&](MoveIndex move) {
+        if (moves_[move].other() != NullMove)
+            wos << L")";
     };
-    function<void(const SMove&, bool)>
-        __writeMove = [&](const SMove& move, bool isOther) {
-            wstring boutStr{ to_wstring((move->nextNo() + 1) / 2) + L". " };
-            bool isEven{ move->nextNo() % 2 == 0 };
-            wos << (isOther ? L"(" + boutStr + (isEven ? L"... " : L"")
-                            : (isEven ? wstring{ L" " } : boutStr))
-                << (isPGN_ZH ? move->zh() : move->iccs()) << L' '
-                << __getRemarkStr(move);
-
-            if (move->other()) {
-                __writeMove(move->other(), true);
-                wos << L")";
-            }
-            if (move->next())
-                __writeMove(move->next(), false);
-        };
 
     wos << __getRemarkStr(rootMove_);
-    if (rootMove_->next())
-        __writeMove(rootMove_->next(), false);
-}
-
-void ChessManual::__readMove_PGN_CC(wistream& wis)
-{
-    const wstring move_remStr{ Tools::getWString(wis) };
-    auto pos0 = move_remStr.find(L"\n("), pos1 = move_remStr.find(L"\n【");
-    wstring moveStr{ move_remStr.substr(0, min(pos0, pos1)) },
-        remStr{ move_remStr.substr(min(pos0, move_remStr.size()), pos1) };
-    wregex line_rg{ LR"(\n)" }, moveStrrg{ LR"(.{5})" },
-        moverg{ LR"(([^…　]{4}[…　]))" },
-        remrg{ LR"(\s*(\(\d+,\d+\)): \{([\s\S]*?)\})" };
-    map<wstring, wstring> rems{};
-    for (wsregex_iterator rp{ remStr.begin(), remStr.end(), remrg };
-         rp != wsregex_iterator{}; ++rp)
-        rems[(*rp)[1]] = (*rp)[2];
-
-    vector<vector<wstring>> moveLines{};
-    for (wsregex_token_iterator lineStrit{ moveStr.begin(), moveStr.end(), line_rg, -1 },
-         end{};
-         lineStrit != end; ++++lineStrit) {
-        vector<wstring> line{};
-        for (wsregex_token_iterator moveit{
-                 (*lineStrit).first, (*lineStrit).second, moveStrrg, 0 };
-             moveit != end; ++moveit)
-            line.push_back(*moveit);
-        moveLines.push_back(line);
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), true, __writeMove, __closeOther, [](MoveIndex) {});
+}
+
+void ChessManual::__readMove_PGN_CC(const wstring& move_remStr, size_t begin)
+{
+    const size_t size{ move_remStr.size() };
+    size_t remPos{ min(move_remStr.find(L"\n(", begin), size) }, infoPos{ min(move_remStr.find(L"\n【", begin), size) },
+        movePos{ min(remPos, infoPos) };
+
+    // 注解：(行,列): {文本}，以整数行、列为键
+    map<RowCol_pair, wstring> rems{};
+    auto __getNum = [&](size_t& pos) {
+        int num{ -1 };
+        for (; pos < infoPos && iswdigit(move_remStr[pos]); ++pos)
+            num = max(num, 0) * 10 + (move_remStr[pos] - L'0');
+        return num;
+    };
+    for (size_t pos{ move_remStr.find(L'(', remPos) }; pos < infoPos; pos = move_remStr.find(L'(', pos)) {
+        int row{ __getNum(++pos) };
+        if (row < 0 || pos >= infoPos || move_remStr[pos] != L',')
+            continue;
+        int col{ __getNum(++pos) };
+        if (col < 0 || move_remStr.compare(pos, 4, L"): {") != 0)
+            continue;
+        size_t end{ move_remStr.find(L'}', pos + 4) };
+        if (end == wstring::npos)
+            break;
+        rems[{ row, col }] = move_remStr.substr(pos + 4, end - pos - 4);
+        pos = end + 1;
     }
-    function<void(SMove&, bool, int, int)>
-        __readMove = [&](SMove& move, bool isOther, int row, int col) {
-            wstring zhStr{ moveLines[row][col] };
-            if (regex_match(zhStr, moverg)) {
-                wstring zhStr0{ zhStr.substr(0, 4) },
-                    remark{ rems[L'(' + to_wstring(row) + L',' + to_wstring(col) + L')'] };
-                auto& newMove = (isOther ? addOtherMove(move, zhStr0, RecFormat::PGN_CC, remark)
-                                         : addNextMove(move, zhStr0, RecFormat::PGN_CC, remark));
-
-                if (zhStr.back() == L'…') {
-                    int inc = 1;
-                    while (moveLines[row][col + inc].front() == L'…')
-                        ++inc;
-                    __readMove(newMove, true, row, col + inc);
-                }
-                if (int(moveLines.size()) - 1 > row
-                    && moveLines[row + 1][col][0] != L'　') {
-                    __done(newMove);
-                    __readMove(newMove, false, row + 1, col);
-                    __undo(newMove);
-                }
-            }
-        };
 
-    rootMove_->setRemark(rems[L"(0,0)"]);
-    if (!moveLines.empty())
-        __readMove(rootMove_, false, 1, 0);
+    // 图中着法行为偶数行（奇数行为连线），每格5字：4字着法，加"…"（有变着）或"　"
+    vector<const wchar_t*> lineBegins{};
+    vector<size_t> lineSizes{};
+    for (size_t pos{ begin }, lineNo{ 0 }; pos < movePos; ++lineNo) {
+        size_t end{ min(move_remStr.find(L'\n', pos), movePos) }, lineEnd{ end };
+        if (lineEnd > pos && move_remStr[lineEnd - 1] == L'\r')
+            --lineEnd;
+        if (lineNo % 2 == 0) {
+            lineBegins.push_back(move_remStr.data() + pos);
+            lineSizes.push_back(lineEnd - pos);
+        }
+        pos = end + 1;
+    }
+    auto __getCell = [&](int row, int col) -> const wchar_t* {
+        return row < static_cast<int>(lineSizes.size()) && (col + 1) * 5 <= static_cast<int>(lineSizes[row])
+            ? lineBegins[row] + col * 5
+            : nullptr;
+    };
+    auto __isMoveCell = [&](const wchar_t* cell) {
+        return cell && find_if(cell, cell + 4, [](wchar_t ch) { return ch == L'…' || ch == L'　'; }) == cell + 4
+            && (cell[4] == L'…' || cell[4] == L'　');
+    };
+
+    vector<RowCol_pair> cells{}; // 各节点在图中的行、列
+    auto __addCellMove = [&](MoveIndex move, bool isOther, int row, int col) {
+        if (!__isMoveCell(__getCell(row, col)))
+            return;
+        MoveIndex newMove{ __addMove(move, isOther) };
+        cells.resize(moves_.size());
+        cells[newMove] = { row, col };
+    };
+    auto __readMove = [&](MoveIndex move, bool) {
+        int row{ cells[move].first }, col{ cells[move].second };
+        const wchar_t* cell{ __getCell(row, col) };
+        moves_[move].setPRowCol_pair(__getPRowCol_pair(wstring(cell, 4), RecFormat::PGN_CC));
+        auto rem = rems.find({ row, col });
+        if (rem != rems.end())
+            __setRemark(move, rem->second);
+
+        if (cell[4] == L'…') {
+            int inc{ 1 };
+            for (const wchar_t* nextCell; (nextCell = __getCell(row, col + inc)) && nextCell[0] == L'…';)
+                ++inc;
+            __addCellMove(move, true, row, col + inc);
+        }
+        __addCellMove(move, false, row + 1, col);
+        __done(move); // 下着在本着之后的局面解析，变着在本着之前的局面解析
+    };
+
+    auto rootRem = rems.find({ 0, 0 });
+    if (rootRem != rems.end())
+        __setRemark(rootMove_, rootRem->second);
+    if (!lineSizes.empty()) {
+        __addCellMove(rootMove_, false, 1, 0);
+        if (moves_[rootMove_].next() != NullMove)
+            __traverse(moves_[rootMove_].next(), false, __readMove,
+                [&](MoveIndex move) { __undo(move); }, [](MoveIndex) {});
+    }
 }
 
 void ChessManual::__writeMove_PGN_CC(wostream& wos) const
 {
     wostringstream remWss{};
-    wstring blankStr((getMaxCol() + 1) * 5, L'　');
-    vector<wstring> lineStr((getMaxRow() + 1) * 2, blankStr);
-    for (int row = lineStr.size() - 1; row > 0; row -= 2)
-        lineStr[row][0] = L' '; // 为显示美观，原宽空格改为窄空格
-    function<void(const SMove&)>
-        __setMovePGN_CC = [&](const SMove& move) {
-            int firstcol{ move->CC_ColNo() * 5 }, row{ move->nextNo() * 2 };
-            lineStr.at(row).replace(firstcol, 4, move->zh());
-            if (!move->remark().empty())
-                remWss << L"(" << move->nextNo() << L"," << move->CC_ColNo() << L"): {"
-                       << move->remark() << L"}\n";
-
-            if (move->next()) {
-                lineStr.at(row + 1).at(firstcol + 2) = L'↓';
-                __setMovePGN_CC(move->next());
-            }
-            if (move->other()) {
-                int fcol{ firstcol + 4 }, num{ move->other()->CC_ColNo() * 5 - fcol };
-                lineStr.at(row).replace(fcol, num, wstring(num, L'…'));
-                __setMovePGN_CC(move->other());
+    vector<MoveIndex> cellMoves{}; // 着法节点按图中行、列排序，逐行输出，空白随写随补
+    cellMoves.reserve(moves_.size());
+    auto __addCellMove = [&](MoveIndex move, bool) {
+        const Move& amove{ moves_[move] };
+        cellMoves.push_back(move);
+        if (!__remark(move).empty())
+            remWss << L"(" << amove.nextNo() << L"," << amove.CC_ColNo() << L"): {"
+                   << __remark(move) << L"}\n";
+    };
+
+    if (!__remark(rootMove_).empty())
+        remWss << L"(0,0): {" << __remark(rootMove_) << L"}\n";
+    if (moves_[rootMove_].next() != NullMove)
+        __traverse(moves_[rootMove_].next(), false, __addCellMove);
+    stable_sort(cellMoves.begin(), cellMoves.end(), [&](MoveIndex amove, MoveIndex bmove) {
+        return make_pair(moves_[amove].nextNo(), moves_[amove].CC_ColNo())
+            < make_pair(moves_[bmove].nextNo(), moves_[bmove].CC_ColNo());
+    });
+
+    const int width{ (getMaxCol() + 1) * 5 };
+    auto __fill = [&](int num, wchar_t ch) { // 不改变调用者流的填充字符
+        if (num > 0)
+            wos << wstring(num, ch);
+    };
+    // 连线行首字为窄空格（为显示美观），有下着的位置为"↓"
+    auto __writeLinkLine = [&](auto cellBegin, auto cellEnd) {
+        int pos{ 1 };
+        wos << L' ';
+        for (auto cell = cellBegin; cell != cellEnd; ++cell)
+            if (moves_[*cell].next() != NullMove) {
+                int linkCol{ moves_[*cell].CC_ColNo() * 5 + 2 };
+                __fill(linkCol - pos, L'　');
+                wos << L'↓';
+                pos = linkCol + 1;
             }
-        };
+        __fill(width - pos, L'　');
+        wos << L'\n';
+    };
 
-    if (!currentMove_->remark().empty())
-        remWss << L"(0,0): {" << currentMove_->remark() << L"}\n";
-    lineStr.front().replace(0, 3, L"　开始");
-    lineStr.at(1).at(2) = L'↓';
-    if (rootMove_->next())
-        __setMovePGN_CC(rootMove_->next());
-    for (auto& line : lineStr)
-        wos << line << L'\n';
+    wos << L"　开始";
+    __fill(width - 3, L'　');
+    wos << L"\n 　↓";
+    __fill(width - 3, L'　');
+    wos << L'\n';
+    auto cellBegin = cellMoves.begin();
+    for (int row = 1; row <= getMaxRow(); ++row) {
+        auto cellEnd = find_if(cellBegin, cellMoves.end(),
+            [&](MoveIndex move) { return moves_[move].nextNo() != row; });
+        int pos{ 0 };
+        for (auto cell = cellBegin; cell != cellEnd; ++cell) {
+            const Move& amove{ moves_[*cell] };
+            int firstcol{ amove.CC_ColNo() * 5 };
+            __fill(firstcol - pos, L'　');
+            wos << amove.zh();
+            pos = firstcol + 4;
+            if (amove.other() != NullMove) {
+                int num{ moves_[amove.other()].CC_ColNo() * 5 - pos };
+                __fill(num, L'…');
+                pos += max(num, 0);
+            }
+        }
+        __fill(width - pos, L'　');
+        wos << L'\n';
+        __writeLinkLine(cellBegin, cellEnd);
+        cellBegin = cellEnd;
+    }
     wos << remWss.str() << __moveInfo();
 }
 /* ===== ChessManual end. ===== */
 
+/* ===== ManualArchive start. ===== */
+static constexpr char ArchiveMagic[]{ "CMA" };
+static constexpr int ArchiveMagicSize{ 3 }, ArchiveVersion{ 1 },
+    ArchiveHeadSize{ 16 }; // 文件标记、版本号、棋谱数（4字节）、索引位置（8字节）
+
+ManualArchive::ManualArchive(const string& filename)
+{
+#ifdef _WIN32
+    HANDLE file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        throw runtime_error("归档文件打开失败");
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file, &fileSize);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    if (size_ > 0)
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // 映射保持对文件的引用
+    if (mapping_)
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd{ open(filename.c_str(), O_RDONLY) };
+    if (fd < 0)
+        throw runtime_error("归档文件打开失败");
+    struct stat st {};
+    fstat(fd, &st);
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void* data{ mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) };
+        if (data != MAP_FAILED)
+            data_ = static_cast<const char*>(data);
+    }
+    close(fd); // 映射保持对文件的引用
+#endif
+    if (!data_ || size_ < ArchiveHeadSize || memcmp(data_, ArchiveMagic, ArchiveMagicSize) != 0
+        || data_[ArchiveMagicSize] != ArchiveVersion) {
+        __unmap();
+        throw runtime_error("归档文件格式错误");
+    }
+
+    uint32_t count{ static_cast<uint32_t>(getUInt(data_ + 4, 4)) };
+    uint64_t indexOffset{ getUInt(data_ + 8, 8) };
+    size_t pos{ static_cast<size_t>(min<uint64_t>(indexOffset, size_)) };
+    auto __getBytes = [&](size_t len) {
+        if (len > size_ - pos)
+            throw runtime_error("归档文件索引不完整");
+        const char* bytes{ data_ + pos };
+        pos += len;
+        return bytes;
+    };
+    auto __getVarint = [&]() {
+        uint32_t value{ 0 };
+        for (int shift = 0; shift < 35; shift += 7) {
+            unsigned char byte = *__getBytes(1);
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw runtime_error("归档文件格式错误");
+    };
+
+    try {
+        if (indexOffset < ArchiveHeadSize || indexOffset > size_)
+            throw runtime_error("归档文件格式错误");
+        // 每项至少含偏移、长度及各信息的长度字节，棋谱数不能超出索引的容量
+        constexpr size_t EntryMinSize{ 8 + 4 + ManualArchive::INFOFIELDNUM };
+        if (count > (size_ - indexOffset) / EntryMinSize)
+            throw runtime_error("归档文件索引不完整");
+        entries_.resize(count);
+        for (auto& entry : entries_) {
+            entry.offset = getUInt(__getBytes(8), 8);
+            entry.size = static_cast<uint32_t>(getUInt(__getBytes(4), 4));
+            if (entry.offset < ArchiveHeadSize || entry.offset > indexOffset || entry.size > indexOffset - entry.offset)
+                throw runtime_error("归档文件格式错误");
+            for (auto& value : entry.info) {
+                uint32_t len{ __getVarint() };
+                const char* str{ __getBytes(len) };
+                value = Tools::utf82ws(str, len);
+            }
+        }
+    } catch (...) {
+        __unmap();
+        throw;
+    }
+}
+
+ManualArchive::~ManualArchive()
+{
+    __unmap();
+}
+
+void ManualArchive::__unmap()
+{
+#ifdef _WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = nullptr;
+}
+
+void ManualArchive::read(int no, ChessManual& cm) const
+{
+    const Entry& entry{ getEntry(no) };
+    cm.readBIN(data_ + entry.offset, entry.size);
+}
+
+const wstring& ManualArchive::getInfoKey(InfoField field)
+{
+    static const wstring infoKeys[INFOFIELDNUM]{ L"Red", L"Black", L"Event", L"Date", L"Result", FENKey };
+    return infoKeys[field];
+}
+
+int ManualArchive::pack(const string& dirfrom, const string& filename)
+{
+    namespace fs = std::filesystem;
+    vector<fs::path> files{};
+    for (auto& entry : fs::recursive_directory_iterator{ dirfrom })
+        if (entry.is_regular_file()) {
+            string ext{ Tools::getExtStr(entry.path().filename().string()) };
+            if (isManualExt(ext))
+                files.push_back(entry.path());
+        }
+    sort(files.begin(), files.end());
+
+    // 先写入临时文件，完整写好文件头及索引后再改名，中途失败不留下残缺的归档文件
+    const string tmpname{ filename + ".tmp" };
+    ofstream os{ tmpname, ios_base::binary };
+    if (os.fail())
+        throw runtime_error("归档文件创建失败");
+    string head(ArchiveHeadSize, '\0'), index{};
+    vector<string> errors{}; // 不能读取的文件跳过，不写入记录
+    int count{ 0 };
+    try {
+        os.write(head.data(), head.size()); // 先占位，写完记录后回填
+
+        ChessManual cm{};
+        uint64_t offset{ ArchiveHeadSize };
+        for (auto& file : files) {
+            try {
+                ifstream is{ file, ios_base::binary };
+                string bytes{ readBytes(is) };
+                RecFormat fmt{ getRecFormat(Tools::getExtStr(file.filename().string())) };
+                detectRecFormat(bytes, fmt);
+                cm.readData(bytes, fmt);
+            } catch (const exception& e) {
+                errors.push_back(file.string() + ": " + e.what());
+                continue;
+            }
+            string bytes{ cm.getBIN() };
+            os.write(bytes.data(), bytes.size());
+
+            appendUInt(index, offset, 8);
+            appendUInt(index, bytes.size(), 4);
+            for (int field = 0; field != INFOFIELDNUM; ++field)
+                appendUTF8(index, cm.getInfo(getInfoKey(static_cast<InfoField>(field))));
+            offset += bytes.size();
+            ++count;
+        }
+        os.write(index.data(), index.size());
+
+        head.assign(ArchiveMagic, ArchiveMagicSize);
+        head.push_back(ArchiveVersion);
+        appendUInt(head, count, 4);
+        appendUInt(head, offset, 8);
+        os.seekp(0);
+        os.write(head.data(), head.size());
+        os.close();
+        if (os.fail())
+            throw runtime_error("归档文件写入失败");
+        fs::rename(tmpname, filename);
+    } catch (...) {
+        os.close();
+        error_code ec{};
+        fs::remove(tmpname, ec);
+        throw;
+    }
+
+    if (!errors.empty()) {
+        cout << filename << ": 跳过" << errors.size() << "个文件:\n";
+        for (auto& error : errors)
+            cout << "   " << error << '\n';
+    }
+    return count;
+}
+/* ===== ManualArchive end. ===== */
+
 const string getExtName(const RecFormat fmt)
 {
     return fmt_ext.at(fmt);
@@ -978,54 +1879,221 @@ RecFormat getRecFormat(const string& ext)
     return RecFormat::PGN_CC;
 }
 
-void transDir(const string& dirfrom, const RecFormat fmt)
+bool detectRecFormat(const string& bytes, RecFormat& fmt)
 {
-    int fcount{}, dcount{}, movcount{}, remcount{}, remlenmax{};
-    string extensions{ ".xqf.pgn_iccs.pgn_zh.pgn_cc.bin.json" };
-    string dirto{ dirfrom.substr(0, dirfrom.rfind('.')) + getExtName(fmt) };
-    function<void(const string&, const string&)>
-        __trans = [&](const string& dirfrom, const string& dirto) {
-            long hFile = 0; //文件句柄
-            struct _finddata_t fileinfo; //文件信息
-            if (_access(dirto.c_str(), 0) != 0)
-                _mkdir(dirto.c_str());
-            if ((hFile = _findfirst((dirfrom + "/*").c_str(), &fileinfo)) != -1) {
-                do {
-                    string filename{ fileinfo.name };
-                    if (fileinfo.attrib & _A_SUBDIR) { //如果是目录,迭代之
-                        if (filename != "." && filename != "..") {
-                            dcount += 1;
-                            __trans(dirfrom + "/" + filename, dirto + "/" + filename);
-                        }
-                    } else { //如果是文件,执行转换
-                        string infilename{ dirfrom + "/" + filename };
-                        string fileto{ dirto + "/" + filename.substr(0, filename.rfind('.')) };
-                        string ext_old{ Tools::getExtStr(filename) };
-                        if (extensions.find(ext_old) != string::npos) {
-                            fcount += 1;
-
-                            //cout << infilename << endl;
-                            ChessManual ci(infilename);
-                            //cout << infilename << " read finished!" << endl;
-                            //cout << fileto << endl;
-                            ci.write(fileto + getExtName(fmt));
-                            //cout << fileto + getExtName(fmt) << " write finished!" << endl;
-
-                            movcount += ci.getMovCount();
-                            remcount += ci.getRemCount();
-                            remlenmax = max(remlenmax, ci.getRemLenMax());
-                        } else
-                            Tools::copyFile(infilename.c_str(), (fileto + ext_old).c_str());
-                    }
-                } while (_findnext(hFile, &fileinfo) == 0);
-                _findclose(hFile);
+    // XQF：文件标记、版本号（不高于18），版本11起密钥校验和为0
+    if (bytes.compare(0, 2, "XQ") == 0) {
+        if (bytes.size() < XQF_HeadSize + 4)
+            return false;
+        unsigned char version = bytes[XQF_Version];
+        if (version == 0 || version > 18)
+            return false;
+        if (version > 10 && (bytes[XQF_KeysSum] + bytes[XQF_KeysSum + 1] + bytes[XQF_KeysSum + 2] + bytes[XQF_KeysSum + 3]) % 256 != 0)
+            return false;
+        fmt = RecFormat::XQF;
+        return true;
+    }
+    // 版本2有文件头；旧版本以标志字节（含信息项）、信息项数、首个键的长度（4字节，高位为0）开始
+    if (bytes.compare(0, BINMagicSize, BINMagic) == 0
+        || (bytes.size() > 5 && (bytes[0] & 0x9F) == 0x80 && bytes[1] > 0
+            && bytes[3] == 0 && bytes[4] == 0 && bytes[5] == 0
+            && static_cast<unsigned char>(bytes[2]) <= bytes.size() - 6)) {
+        fmt = RecFormat::BIN;
+        return true;
+    }
+
+    // 文本格式只检查开头部分，截于行末以免截断多字节字符
+    constexpr size_t SniffSize{ 4096 };
+    size_t size{ min(bytes.size(), SniffSize) };
+    if (size < bytes.size()) {
+        size_t lineEnd{ bytes.rfind('\n', size - 1) };
+        if (lineEnd != string::npos)
+            size = lineEnd + 1;
+    }
+    const wstring text{ Tools::decodeText(bytes.substr(0, size)) };
+    const wchar_t* blanks{ L" \t\r\n" };
+    size_t pos{ text.find_first_not_of(blanks) };
+    if (pos == wstring::npos)
+        return false;
+    // JSON：对象为空，或首个成员为本程序写入的键
+    if (text[pos] == L'{') {
+        size_t next{ text.find_first_not_of(blanks, pos + 1) };
+        if (next == wstring::npos || text[next] == L'}'
+            || text.compare(next, 6, L"\"info\"") == 0 || text.compare(next, 8, L"\"remark\"") == 0
+            || text.compare(next, 7, L"\"moves\"") == 0) {
+            fmt = RecFormat::JSON;
+            return true;
+        }
+        return false;
+    }
+
+    // PGN：每个信息行须为[Key "Value"]，之后按首个着法区分；不能确定时返回false
+    auto __isTagPair = [&](size_t begin, size_t end) {
+        size_t keyEnd{ begin + 1 };
+        while (keyEnd < end && (iswalnum(text[keyEnd]) || text[keyEnd] == L'_'))
+            ++keyEnd;
+        end = text.find_last_not_of(blanks, end - 1) + 1;
+        return keyEnd > begin + 1 && text.compare(keyEnd, 2, L" \"") == 0
+            && end >= keyEnd + 4 && text.compare(end - 2, 2, L"\"]") == 0;
+    };
+    if (text[pos] != L'[')
+        return false;
+    while (pos < text.size() && text[pos] == L'[') {
+        size_t lineEnd{ min(text.find(L'\n', pos), text.size()) };
+        if (!__isTagPair(pos, lineEnd))
+            return false;
+        pos = min(text.find_first_not_of(blanks, lineEnd), text.size());
+    }
+    if (text.compare(pos, 3, L"　开始") == 0) {
+        fmt = RecFormat::PGN_CC;
+        return true;
+    }
+    const wstring zhChars{ PieceManager::getZhChars() };
+    auto __isICCSCol = [](wchar_t ch) { return ch >= L'a' && ch <= L'i'; };
+    auto __isDigit = [](wchar_t ch) { return ch >= L'0' && ch <= L'9'; };
+    for (; pos < text.size(); ++pos) {
+        wchar_t ch{ text[pos] };
+        if (ch == L'{') { // 跳过注解
+            pos = text.find(L'}', pos);
+            if (pos == wstring::npos)
+                break;
+        } else if (pos + 4 <= text.size() && __isICCSCol(ch) && __isDigit(text[pos + 1])
+            && __isICCSCol(text[pos + 2]) && __isDigit(text[pos + 3])
+            && (pos == 0 || !iswalnum(text[pos - 1])) && (pos + 4 == text.size() || !iswalnum(text[pos + 4]))) {
+            fmt = RecFormat::PGN_ICCS;
+            return true;
+        } else if (pos + 4 <= text.size()
+            && all_of(text.begin() + pos, text.begin() + pos + 4,
+                [&](wchar_t zh) { return zhChars.find(zh) != wstring::npos; })) {
+            fmt = RecFormat::PGN_ZH;
+            return true;
+        }
+    }
+    return false; // 无着法或着法在检查范围之外，由扩展名决定
+}
+
+void transDir(const string& dirfrom, const RecFormat fmt, int threadNum)
+{
+    namespace fs = std::filesystem;
+    const fs::path fromPath{ dirfrom }, toPath{ dirfrom.substr(0, dirfrom.rfind('.')) + getExtName(fmt) };
+    int dcount{};
+    vector<fs::path> files{}; // 相对于源目录的文件路径
+    fs::create_directories(toPath);
+    for (auto& entry : fs::recursive_directory_iterator{ fromPath }) {
+        fs::path relPath{ fs::relative(entry.path(), fromPath) };
+        if (entry.is_directory()) {
+            ++dcount;
+            fs::create_directories(toPath / relPath);
+        } else if (entry.is_regular_file())
+            files.push_back(relPath);
+    }
+    sort(files.begin(), files.end()); // 与目录遍历次序无关，输出确定
+
+    if (threadNum <= 0)
+        threadNum = max(1u, thread::hardware_concurrency());
+    threadNum = max(1, min(threadNum, static_cast<int>(files.size())));
+
+    // 每个线程一个任务队列，按顺序分块：先取自己的队首，取完后从其他队列的队尾窃取
+    struct WorkQueue {
+        mutex mtx;
+        deque<int> fileNos;
+    };
+    vector<WorkQueue> queues(threadNum);
+    for (int no = 0; no != static_cast<int>(files.size()); ++no)
+        queues[static_cast<long long>(no) * threadNum / files.size()].fileNos.push_back(no);
+
+    auto __takeFileNo = [&](int queueNo) {
+        for (int i = 0; i != threadNum; ++i) {
+            WorkQueue& queue{ queues[(queueNo + i) % threadNum] };
+            lock_guard<mutex> lock{ queue.mtx };
+            if (queue.fileNos.empty())
+                continue;
+            int no{};
+            if (i == 0) {
+                no = queue.fileNos.front();
+                queue.fileNos.pop_front();
+            } else {
+                no = queue.fileNos.back();
+                queue.fileNos.pop_back();
             }
-        };
+            return no;
+        }
+        return -1;
+    };
 
-    __trans(dirfrom, dirto);
-    cout << dirfrom + " =>" << getExtName(fmt) << ": 转换" << fcount << "个文件, "
+    struct TransCount {
+        int fcount{}, movcount{}, remcount{}, remlenmax{};
+        vector<string> errors{}; // 读取或转换失败的文件及原因
+    };
+    vector<TransCount> counts(threadNum);
+    auto __work = [&](int queueNo) {
+        ChessManual ci{}; // 各线程使用独立的棋谱对象
+        TransCount& count{ counts[queueNo] };
+        for (int no = __takeFileNo(queueNo); no >= 0; no = __takeFileNo(queueNo)) {
+            const fs::path& relPath{ files[no] };
+            string ext_old{ Tools::getExtStr(relPath.filename().string()) };
+            fs::path infilename{ fromPath / relPath }, fileto{ toPath / relPath };
+            string bytes{};
+            try {
+                ifstream is{ infilename, ios_base::binary };
+                bytes = readBytes(is); // 只读取一次，识别格式与解析共用
+            } catch (const exception& e) {
+                count.errors.push_back(infilename.string() + ": " + e.what());
+                continue;
+            }
+            bool isManual{ isManualExt(ext_old) };
+            RecFormat fmt_old{ getRecFormat(ext_old) };
+            // 无扩展名的文件按内容识别，不能识别时直接复制；其他扩展名的文件不识别
+            if ((isManual || ext_old.empty()) && (detectRecFormat(bytes, fmt_old) || isManual)) {
+                fs::path manualto{ fs::path{ fileto }.replace_extension(getExtName(fmt)) };
+                bool isWriting{ false };
+                try { // 格式错误或写入失败的文件不中止整个转换，改为直接复制
+                    ci.readData(bytes, fmt_old);
+                    isWriting = true;
+                    ci.write(manualto.string());
+                    ++count.fcount;
+                    count.movcount += ci.getMovCount();
+                    count.remcount += ci.getRemCount();
+                    count.remlenmax = max(count.remlenmax, ci.getRemLenMax());
+                    continue;
+                } catch (const exception& e) {
+                    count.errors.push_back(infilename.string() + ": " + e.what() + "（已直接复制）");
+                    error_code ec{};
+                    if (isWriting && fs::is_regular_file(manualto, ec))
+                        fs::remove(manualto, ec); // 不留下写了一半的文件
+                }
+            }
+            ofstream os{ fileto, ios_base::binary };
+            os.write(bytes.data(), bytes.size());
+            os.close();
+            if (os.fail())
+                count.errors.push_back(fileto.string() + ": 文件复制失败");
+        }
+    };
+    vector<thread> threads{};
+    for (int i = 1; i < threadNum; ++i)
+        threads.emplace_back(__work, i);
+    __work(0);
+    for (auto& th : threads)
+        th.join();
+
+    TransCount total{};
+    for (auto& count : counts) {
+        total.fcount += count.fcount;
+        total.movcount += count.movcount;
+        total.remcount += count.remcount;
+        total.remlenmax = max(total.remlenmax, count.remlenmax);
+        total.errors.insert(total.errors.end(), count.errors.begin(), count.errors.end());
+    }
+    sort(total.errors.begin(), total.errors.end());
+    cout << dirfrom + " =>" << getExtName(fmt) << ": 转换" << total.fcount << "个文件, "
          << dcount << "个目录成功！\n   着法数量: "
-         << movcount << ", 注释数量: " << remcount << ", 最大注释长度: " << remlenmax << endl;
+         << total.movcount << ", 注释数量: " << total.remcount << ", 最大注释长度: " << total.remlenmax << endl;
+    if (!total.errors.empty()) {
+        cout << "   失败" << total.errors.size() << "个文件:\n";
+        for (auto& error : total.errors)
+            cout << "   " << error << '\n';
+    }
 }
 
 void testTransDir(int fd, int td, int ff, int ft, int tf, int tt)
@@ -1055,24 +2123,14 @@ const wstring testChessmanual()
     ChessManual cm{};
     //*
     cm.read("01.xqf");
-
-    cm.write("01.bin");
-    cm.read("01.bin");
-
-    cm.write("01.json");
-    cm.read("01.json");
-
-    cm.write("01.pgn_iccs");
-    cm.read("01.pgn_iccs");
-
-    cm.write("01.pgn_zh");
-    cm.read("01.pgn_zh");
-
-    cm.write("01.pgn_cc");
-    cm.read("01.pgn_cc");
-
-    cm.write("01.pgn_cc");
-    cm.read("01.pgn_cc");
+    const string bin{ cm.getBIN() }; // 依次写入各格式再读取，内容（含注解）应保持不变
+    for (auto& ext : { ".bin", ".json", ".pgn_iccs", ".pgn_zh", ".pgn_cc", ".pgn_cc" }) {
+        string filename{ string{ "01" } + ext };
+        cm.write(filename);
+        cm.read(filename);
+        wos << wstring{ filename.begin(), filename.end() }
+            << (cm.getBIN() == bin ? L": 往返一致\n" : L": 往返不一致！\n");
+    }
     //*/
     wos << boolalpha << cm.isBottomSide(PieceColor::RED) << L'\n'
         << cm.getPieceChars() << L'\n' << cm.getBoardStr().c_str();
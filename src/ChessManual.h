@@ -3,44 +3,43 @@
 // 中国象棋棋盘布局类型 by-cjp
 
 #include "ChessType.h"
+#include "Piece.h"
+#include "Seat.h"
 
 namespace ChessManualSpace {
 
 class ChessManual {
-    class Move;
-    typedef shared_ptr<ChessManual::Move> SMove;
+    typedef int32_t MoveIndex; // 着法节点在moves_中的序号
 
 private:
-    // 着法节点类
-    class Move : public enable_shared_from_this<Move> {
+    static constexpr MoveIndex NullMove{ -1 };
+
+    // 着法节点类：集中存放于moves_，以序号链接前着、下着、变着
+    class Move {
     public:
         int frowcol() const;
         int trowcol() const;
 
-        PRowCol_pair getPRowCol_pair() const { return prowcol_pair_; }
+        MoveCode moveCode() const { return moveCode_; }
+        PRowCol_pair getPRowCol_pair() const { return moveCode_.getPRowCol_pair(); }
         const wstring iccs() const;
-        const wstring& zh() const { return zhStr_; }
-        const wstring& remark() const { return remark_; }
-        const SPiece& eatPie() const { return eatPie_; }
-        const SMove& next() const { return next_; }
-        const SMove& other() const { return other_; }
-        const SMove prev() const { return prev_.lock(); }
-
-        SMove& addNext(const PRowCol_pair& prowcol_pair, const wstring& remark);
-        SMove& addOther(const PRowCol_pair& prowcol_pair, const wstring& remark);
-
-        void setPRowCol_pair(const PRowCol_pair& prowcol_pair) { prowcol_pair_ = prowcol_pair; }
-        void setEatPie(const SPiece& eatPie) { eatPie_ = eatPie; }
-        void setRemark(const wstring& remark) { remark_ = remark; }
-        void setPrev(const weak_ptr<Move>& prev) { prev_ = prev; }
-        void setZhStr(const wstring& zhStr) { zhStr_ = zhStr; }
-
-        vector<SMove> getPrevMoves();
-
-        void cutNext() { next_ = nullptr; }
-        void cutOther() { other_ && (other_ = other_->other_); }
-
-        const wstring toString();
+        const wstring zh() const { return zhStr_[0] ? wstring(zhStr_, ZhLen_) : wstring{}; }
+        Piece eatPie() const { return eatPie_; }
+        uint64_t hashKey() const { return hashKey_; } // 走子后局面的键值
+        MoveIndex next() const { return next_; }
+        MoveIndex other() const { return other_; }
+        MoveIndex prev() const { return prev_; }
+        int remarkNo() const { return remarkNo_; } // 注释在remarks_中的序号，无注释为-1
+
+        void setMoveCode(MoveCode moveCode) { moveCode_ = moveCode; }
+        void setPRowCol_pair(const PRowCol_pair& prowcol_pair) { moveCode_ = MoveCode{ prowcol_pair }; }
+        void setEatPie(Piece eatPie) { eatPie_ = eatPie; }
+        void setHashKey(uint64_t hashKey) { hashKey_ = hashKey; }
+        void setRemarkNo(int remarkNo) { remarkNo_ = remarkNo; }
+        void setZhStr(const wstring& zhStr);
+        void setNext(MoveIndex next) { next_ = next; }
+        void setOther(MoveIndex other) { other_ = other; }
+        void setPrev(MoveIndex prev) { prev_ = prev; }
 
         int nextNo() const { return nextNo_; }
         int otherNo() const { return otherNo_; }
@@ -51,31 +50,35 @@ private:
         void setCC_ColNo(int CC_ColNo) { CC_ColNo_ = CC_ColNo; }
 
     private:
-        PRowCol_pair prowcol_pair_{};
-        wstring remark_{}; // 注释
-        weak_ptr<Move> prev_{};
-
-        wstring zhStr_{}; // 中文着法描述
-        SPiece eatPie_{};
-        SMove next_{}, other_{};
-
-        int nextNo_{ 0 }, otherNo_{ 0 }, CC_ColNo_{ 0 }; // CC_ColNo_:图中列位置（需在ChessManual::setMoves确定）
-
-        SMove& __addNext();
-        SMove& __addOther();
+        static constexpr int ZhLen_{ 4 };
+
+        MoveCode moveCode_{}; // 起止位置编码
+        Piece eatPie_{};
+        MoveIndex prev_{ NullMove }, next_{ NullMove }, other_{ NullMove };
+        int32_t remarkNo_{ -1 };
+        int32_t nextNo_{ 0 }, otherNo_{ 0 }, CC_ColNo_{ 0 }; // CC_ColNo_:图中列位置（需在ChessManual::setMoves确定）
+        uint64_t hashKey_{ 0 };
+        wchar_t zhStr_[ZhLen_]{}; // 中文着法描述，固定四字
     };
 
 public:
     ChessManual(const string& infilename = string{});
     void reset(); // 重置为常规的下棋初始状态，不需手工布子
 
-    SMove& addNextMove(SMove& move, const PRowCol_pair& prowcol_pair, const wstring& remark) const;
-    SMove& addOtherMove(SMove& move, const PRowCol_pair& prowcol_pair, const wstring& remark) const;
-    SMove& addNextMove(SMove& move, const wstring& str, RecFormat fmt, const wstring& remark) const;
-    SMove& addOtherMove(SMove& move, const wstring& str, RecFormat fmt, const wstring& remark) const;
+    MoveIndex addNextMove(MoveIndex move, const PRowCol_pair& prowcol_pair, const wstring& remark);
+    MoveIndex addOtherMove(MoveIndex move, const PRowCol_pair& prowcol_pair, const wstring& remark);
+    MoveIndex addNextMove(MoveIndex move, const wstring& str, RecFormat fmt, const wstring& remark);
+    MoveIndex addOtherMove(MoveIndex move, const wstring& str, RecFormat fmt, const wstring& remark);
 
     void read(const string& infilename);
+    // PGN格式写为UTF-8、CRLF换行（读取时兼容GBK）；文件创建或写入失败时抛出异常
     void write(const string& outfilename);
+    // 已读入内存的文件内容（XQF就地解密）
+    void readData(string& bytes, RecFormat fmt);
+    // 内存中的BIN记录，供归档文件使用
+    void readBIN(const char* data, size_t size);
+    const string getBIN() const;
+    const wstring getInfo(const wstring& key) const; // 无此项时为空
 
     void go();
     void back();
@@ -86,7 +89,10 @@ public:
 
     void changeSide(ChangeType ct);
 
-    RowCol_pair getMoveCoord() const { return { currentMove_->CC_ColNo(), currentMove_->nextNo() }; }
+    RowCol_pair getMoveCoord() const { return { moves_[currentMove_].CC_ColNo(), moves_[currentMove_].nextNo() }; }
+    uint64_t getHashKey() const; // 当前局面的键值
+    // 走子后局面的键值为hashKey的全部着法（含初始局面）在视图中的位置，用于查找变着间的相同局面
+    const RowCol_pair_vector findPosition(uint64_t hashKey);
     int getMovCount() const { return movCount_; }
     int getRemCount() const { return remCount_; }
     int getRemLenMax() const { return remLenMax_; }
@@ -96,50 +102,121 @@ public:
     bool isBottomSide(PieceColor color) const;
     const wstring getPieceChars() const;
     const wstring getBoardStr() const;
-    const wstring getCurmoveStr() const;
-    const wstring getMoveStr() const;
+    const wstring getCurmoveStr();
+    const wstring getMoveStr();
     const wstring toString();
 
 private:
     map<wstring, wstring> info_;
     SBoard board_;
-    SMove rootMove_, currentMove_;
+    vector<Move> moves_; // 全部着法节点，序号0为根节点
+    vector<wstring> remarks_; // 全部注释，着法节点仅记录序号
+    MoveIndex rootMove_{ 0 }, currentMove_{ 0 };
     int movCount_{ 0 }, remCount_{ 0 }, remLenMax_{ 0 }, maxRow_{ 0 }, maxCol_{ 0 };
-
-    void __backTo(const SMove& move);
-    void __done(const SMove& move);
-    void __undo(const SMove& move);
+    bool hasZhStr_{ false }; // 中文着法是否与着法树一致
+    bool hasHashKey_{ false }; // 局面键值是否与着法树一致
+
+    void __clearMoves();
+    MoveIndex __addMove(MoveIndex move, bool isOther); // 添加空节点，由读取函数随后填写
+    MoveIndex __addMove(MoveIndex move, bool isOther, const PRowCol_pair& prowcol_pair, const wstring& remark);
+    const wstring& __remark(MoveIndex move) const;
+    void __setRemark(MoveIndex move, const wstring& remark);
+    vector<MoveIndex> __getPrevMoves(MoveIndex move) const;
+    const wstring __moveStr(MoveIndex move) const;
+
+    // 非递归深度优先遍历以move为首的子树（先下着后变着，otherFirst时先变着后下着）：
+    // enter(move, isOther)进入节点，此时可添加其下着、变着；leave(move)先访问的子树已遍历完毕；
+    // branch(move)即将转入后访问的子树
+    template <typename Enter, typename Leave, typename Branch>
+    void __traverse(MoveIndex move, bool otherFirst, Enter&& enter, Leave&& leave, Branch&& branch) const;
+    template <typename Enter>
+    void __traverse(MoveIndex move, bool otherFirst, Enter&& enter) const;
+
+    void __backTo(MoveIndex move);
+    void __done(MoveIndex move);
+    void __undo(MoveIndex move);
 
     void __setFENplusFromFEN(const wstring& FEN, PieceColor color);
     void __setBoardFromInfo();
 
     PRowCol_pair __getPRowCol_pair(const wstring& str, RecFormat fmt) const;
-    void __setMoveZhStrAndNums();
+    // 计数及图中列位置只需遍历树；中文着法需推演棋盘，仅在输出中文时计算；
+    // 局面键值只需走子，读取后即计算
+    void __setMoveNums();
+    void __setMoveZhStrs();
+    void __requireZhStrs();
+    void __setMoveHashKeys(); // 棋盘须位于初始局面；着法无效时抛出异常
+    void __requireHashKeys();
 
     const wstring __moveInfo() const;
 
-    void __readXQF(istream& is);
+    void __readXQF(string& bytes); // 就地解密整个文件的缓冲区
+    void __writeXQF(ostream& os) const; // 版本18
 
-    void __readBIN(istream& is);
-    void __writeBIN(ostream& os) const;
+    void __readBIN(const char* data, size_t size); // 按文件头区分版本2及旧版本
+    void __readBIN_v1(const char* data, size_t size);
+    void __writeBIN(string& bytes) const; // 版本2
 
-    void __readJSON(istream& is);
-    void __writeJSON(ostream& os) const;
+    void __readJSON(const char* data, size_t size); // 逐个成员解析，不建立文档树
+    void __writeJSON(string& bytes) const; // 紧凑格式，UTF-8
 
-    void __readInfo_PGN(wistream& wis);
+    void __readInfo_PGN(const wstring& text, size_t& pos); // pos移至信息之后的空行之后
     void __writeInfo_PGN(wostream& wos) const;
 
-    void __readMove_PGN_ICCSZH(wistream& wis, RecFormat fmt);
+    void __readMove_PGN_ICCSZH(const wstring& moveStr, size_t pos, RecFormat fmt);
     void __writeMove_PGN_ICCSZH(wostream& wos, RecFormat fmt) const;
 
-    void __readMove_PGN_CC(wistream& wis);
+    void __readMove_PGN_CC(const wstring& move_remStr, size_t begin);
     void __writeMove_PGN_CC(wostream& wos) const;
 };
 
+// 多棋谱归档文件：文件头（"CMA"、版本号、棋谱数、索引位置）之后依次存放各棋谱的BIN记录，
+// 文件尾为索引（记录的偏移、长度及主要信息）；映射整个文件，按序号直接读取任一棋谱
+class ManualArchive {
+public:
+    enum InfoField { RED,
+        BLACK,
+        EVENT,
+        DATE,
+        RESULT,
+        FEN,
+        INFOFIELDNUM };
+    struct Entry {
+        uint64_t offset;
+        uint32_t size;
+        wstring info[INFOFIELDNUM];
+    };
+
+    explicit ManualArchive(const string& filename);
+    ~ManualArchive();
+    ManualArchive(const ManualArchive&) = delete;
+    ManualArchive& operator=(const ManualArchive&) = delete;
+
+    int size() const { return entries_.size(); }
+    const Entry& getEntry(int no) const { return entries_.at(no); }
+    void read(int no, ChessManual& cm) const;
+
+    static const wstring& getInfoKey(InfoField field);
+    // 将目录下的全部棋谱文件（含子目录，按路径排序）打包为归档文件，返回棋谱数；
+    // 不能读取的文件跳过并列出
+    static int pack(const string& dirfrom, const string& filename);
+
+private:
+    void __unmap(); // 只释放映射，构造失败时也可调用
+
+    const char* data_{ nullptr };
+    size_t size_{ 0 };
+    void* mapping_{ nullptr }; // Windows下的文件映射句柄
+    vector<Entry> entries_;
+};
+
 const string getExtName(const RecFormat fmt);
 RecFormat getRecFormat(const string& ext);
+// 按文件开头的内容识别格式，可确定时修改fmt并返回true，否则fmt不变
+bool detectRecFormat(const string& bytes, RecFormat& fmt);
 
-void transDir(const string& dirfrom, const RecFormat fmt);
+// 转换目录下的全部棋谱文件（含子目录），其他文件直接复制；threadNum <= 0 时按硬件线程数
+void transDir(const string& dirfrom, const RecFormat fmt, int threadNum = 0);
 void testTransDir(int fd, int td, int ff, int ft, int tf, int tt);
 
 const wstring testChessmanual();
@@ -2,36 +2,49 @@
 #define CHESSTYPE_H
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <codecvt>
-#include <direct.h>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <functional>
-#include <io.h>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace PieceSpace {
 class Piece;
-class Pieces;
 class PieceManager;
 }
 
 namespace SeatSpace {
-class Seat;
+class MoveCode;
+class MoveList;
 class Seats;
 class SeatManager;
 }
 
+namespace BitboardSpace {
+class Bitboard;
+class Bitboards;
+class BitboardManager;
+}
+
 namespace BoardSpace {
 class Board;
 }
@@ -43,13 +56,12 @@ class ChessManual;
 using namespace std;
 using namespace PieceSpace;
 using namespace SeatSpace;
+using namespace BitboardSpace;
 using namespace BoardSpace;
 using namespace ChessManualSpace;
 
-typedef shared_ptr<Piece> SPiece;
-
-typedef shared_ptr<Seat> SSeat;
-typedef vector<SSeat> SSeat_vector;
+typedef int Seat; // 棋盘位置：带边界填充的棋盘数组下标
+typedef vector<Seat> Seat_vector;
 
 typedef pair<int, int> RowCol_pair;
 typedef pair<pair<int, int>, pair<int, int>> PRowCol_pair;
@@ -95,6 +107,7 @@ constexpr auto PIECENUM = 32;
 constexpr auto BOARDROWNUM = 10;
 constexpr auto BOARDCOLNUM = 9;
 constexpr auto SEATNUM = BOARDROWNUM * BOARDCOLNUM;
+constexpr auto SEATPADNUM = 256; // 16行16列，棋盘四周填充边界
 
 /*
 class chs_codecvt : public std::codecvt_byname<wchar_t, char, std::mbstate_t> {
@@ -0,0 +1,15 @@
+﻿#ifndef GBKTABLE_H
+#define GBKTABLE_H
+// GBK双字节字符与Unicode的对照表，供编码转换使用
+
+#include <cstdint>
+
+namespace Tools {
+
+constexpr int GBKLeadFirst{ 0x81 }, GBKLeadNum{ 126 }; // 首字节0x81~0xFE
+constexpr int GBKTrailFirst{ 0x40 }, GBKTrailNum{ 191 }; // 尾字节0x40~0xFE（0x7F无对应字符）
+
+extern const uint16_t GBKToUnicode[GBKLeadNum * GBKTrailNum];
+}
+
+#endif
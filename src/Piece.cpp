@@ -1,82 +1,204 @@
 ﻿#include "Piece.h"
-#include "Seat.h"
 
 namespace PieceSpace {
 
 /* ===== Piece start. ===== */
+// 按棋子编码（颜色位|种类序号+1）索引的字符、名称表
+static const wchar_t codeChars[]{ L"_KABNRCP_kabnrcp" };
+static const wchar_t codeNames[]{ L"_帅仕相马车炮兵_将士象马车炮卒" };
+
 Piece::Piece(wchar_t ch)
-    : ch_{ ch }
-    , name_{ PieceManager::getName(ch) }
-    , color_{ PieceManager::getColor(ch) }
-    , kind_{ PieceManager::getKind(ch) }
+    : code_{ BlankCode_ }
+{
+    for (unsigned char code = 0; code != sizeof(codeChars) / sizeof(codeChars[0]) - 1; ++code)
+        if (code & KindMask_ && codeChars[code] == ch) {
+            code_ = code;
+            break;
+        }
+}
+
+Piece Piece::fromName(PieceColor color, wchar_t name)
 {
+    unsigned char colorBit{ color == PieceColor::BLACK ? ColorBit_ : BlankCode_ };
+    for (unsigned char kind = 1; kind <= KindMask_; ++kind)
+        if (codeNames[colorBit | kind] == name)
+            return Piece{ static_cast<unsigned char>(colorBit | kind) };
+    return Piece{};
 }
 
- const wstring Piece::toString() const
+wchar_t Piece::ch() const { return *this ? codeChars[code_] : PieceManager::nullChar(); }
+
+wchar_t Piece::name() const { return *this ? codeNames[code_] : PieceManager::nullChar(); }
+
+const wstring Piece::toString() const
 {
     wostringstream wos{};
-    wos << (color_ == PieceColor::RED ? L'+' : L'*') << static_cast<int>(kind_)
-        << ch_ << name_ << PieceManager::getPrintName(ch_);
+    wos << (color() == PieceColor::RED ? L'+' : L'*') << static_cast<int>(kind())
+        << ch() << name() << PieceManager::getPrintName(ch());
     return wos.str();
 }
 /* ===== Piece end. ===== */
 
-/* ===== Pieces start. ===== */
-Pieces::Pieces()
+/* ===== PieceManager start. ===== */
+constexpr wchar_t piecesChars[]{ L"KAABBNNRRCCPPPPPkaabbnnrrccppppp" };
+constexpr wchar_t chChars[]{ L"KABNRCPkabnrcp" };
+constexpr wchar_t printNames[]{ L"帅仕相马车炮兵将士象馬車砲卒" }; // 按chChars次序
+constexpr wchar_t preChars[]{ L"前中后" };
+constexpr wchar_t twoPreChars[]{ L"前后" };
+constexpr wchar_t nameChars[]{ L"帅将仕士相象马车炮兵卒" };
+constexpr wchar_t movChars[]{ L"退平进" };
+constexpr wchar_t numChars[2][10]{ L"一二三四五六七八九", L"１２３４５６７８９" }; // 红、黑
+constexpr wchar_t ICCSChars[]{ L"abcdefghi" };
+constexpr wchar_t FirstFENChars[]{ L"rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR" };
+constexpr int chNameIndexs[]{ 0, 2, 4, 6, 7, 8, 9, 1, 3, 5, 6, 7, 8, 10 }; // chChars各字符在nameChars中的序号
+
+// 棋子字符表：按ASCII值索引，值为在chChars中的序号，无则为-1
+constexpr int AsciiNum{ 128 };
+struct CharTable {
+    signed char chIndexs[AsciiNum];
+};
+
+constexpr CharTable makeCharTable()
 {
-    for (auto& ch : PieceManager::getPiecesChars())
-        allPieces_.push_back(make_shared<Piece>(ch));
+    CharTable table{};
+    for (auto& chIndex : table.chIndexs)
+        chIndex = -1;
+    for (int index = 0; chChars[index]; ++index)
+        table.chIndexs[chChars[index]] = index;
+    return table;
 }
 
-const SPiece& Pieces::getOtherPiece(const SPiece& piece) const
+constexpr CharTable charTable{ makeCharTable() };
+
+static int getChIndex(wchar_t ch) { return static_cast<unsigned>(ch) < AsciiNum ? charTable.chIndexs[ch] : -1; }
+
+// 汉字属性表：按字符值散列、线性探查，值为在各字符串中的序号，无则为-1
+struct GlyphInfo {
+    wchar_t glyph;
+    signed char nameIndex, movIndex, preIndex, numIndexs[2];
+};
+
+constexpr int GlyphSlotNum{ 64 }; // 2的幂，大于汉字总数
+struct GlyphTable {
+    GlyphInfo slots[GlyphSlotNum];
+};
+
+constexpr int getGlyphSlot(wchar_t glyph) { return (glyph ^ (glyph >> 6)) & (GlyphSlotNum - 1); }
+
+constexpr GlyphTable makeGlyphTable()
 {
-    if (!piece)
-        return piece;
-    auto first = allPieces_.begin(), last = allPieces_.end();
-    return allPieces_.at((distance(first, find(first, last, piece)) + PIECENUM / 2) % PIECENUM);
+    GlyphTable table{};
+    for (auto& info : table.slots)
+        info = GlyphInfo{ 0, -1, -1, -1, { -1, -1 } };
+    auto __getInfo = [&table](wchar_t glyph) -> GlyphInfo& {
+        int slot{ getGlyphSlot(glyph) };
+        while (table.slots[slot].glyph != 0 && table.slots[slot].glyph != glyph)
+            slot = (slot + 1) & (GlyphSlotNum - 1);
+        table.slots[slot].glyph = glyph;
+        return table.slots[slot];
+    };
+    for (int index = 0; nameChars[index]; ++index)
+        __getInfo(nameChars[index]).nameIndex = index;
+    for (int index = 0; movChars[index]; ++index)
+        __getInfo(movChars[index]).movIndex = index;
+    for (int index = 0; preChars[index]; ++index)
+        __getInfo(preChars[index]).preIndex = index;
+    for (int color = 0; color != 2; ++color)
+        for (int index = 0; numChars[color][index]; ++index)
+            __getInfo(numChars[color][index]).numIndexs[color] = index;
+    return table;
 }
 
-const vector<SPiece> Pieces::getBoardPieces(const wstring& pieceChars) const
+constexpr GlyphTable glyphTable{ makeGlyphTable() };
+
+static const GlyphInfo& getGlyphInfo(wchar_t glyph)
 {
-    vector<SPiece> pieces(SEATNUM);
-    if (pieceChars.size() == SEATNUM) {
-        vector<bool> used(allPieces_.size(), false);
-        int pieceIndex{ 0 }, allPiecesSize = used.size();
-        for_each(pieceChars.begin(), pieceChars.end(),
-            [&](wchar_t ch) {
-                if (ch != PieceManager::nullChar())
-                    for (int index = 0; index < allPiecesSize; ++index)
-                        if (allPieces_[index]->ch() == ch && !used[index]) {
-                            pieces[pieceIndex] = allPieces_[index];
-                            used[index] = true;
-                            break;
-                        }
-                ++pieceIndex;
-            });
-    }
-    return pieces;
+    int slot{ getGlyphSlot(glyph) };
+    while (glyphTable.slots[slot].glyph != 0 && glyphTable.slots[slot].glyph != glyph)
+        slot = (slot + 1) & (GlyphSlotNum - 1);
+    return glyphTable.slots[slot]; // 未找到则为空位，各序号均为-1
 }
 
-const wstring Pieces::toString() const
+static int getNameIndex(wchar_t name) { return getGlyphInfo(name).nameIndex; }
+
+wchar_t PieceManager::getName(wchar_t ch)
 {
-    wostringstream wos{};
-    for (auto& piece : allPieces_)
-        wos << piece->toString() << L' ';
-    return wos.str();
+    int chIndex{ getChIndex(ch) };
+    return chIndex < 0 ? nullChar_ : nameChars[chNameIndexs[chIndex]];
 }
-/* ===== Pieces end. ===== */
 
-/* ===== PieceManager start. ===== */
-const wstring PieceManager::piecesChar_{ L"KAABBNNRRCCPPPPPkaabbnnrrccppppp" };
-const wstring PieceManager::chChars_{ L"KABNRCPkabnrcp" };
-const wstring PieceManager::preChars_{ L"前中后" };
-const wstring PieceManager::nameChars_{ L"帅将仕士相象马车炮兵卒" };
-const wstring PieceManager::movChars_{ L"退平进" };
-const map<PieceColor, wstring> PieceManager::numChars_{
-    { PieceColor::RED, L"一二三四五六七八九" },
-    { PieceColor::BLACK, L"１２３４５６７８９" }
-};
-const wstring PieceManager::ICCSChars_{ L"abcdefghi" };
-const wstring PieceManager::FirstFEN_{ L"rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR" };
+wchar_t PieceManager::getPrintName(wchar_t ch)
+{
+    int chIndex{ getChIndex(ch) };
+    return chIndex < 0 ? nullChar_ : printNames[chIndex];
+}
+
+PieceColor PieceManager::getColorFromZh(wchar_t numZh)
+{
+    return getGlyphInfo(numZh).numIndexs[static_cast<int>(PieceColor::RED)] >= 0 ? PieceColor::RED : PieceColor::BLACK;
+}
+
+PieceKind PieceManager::getKind(wchar_t ch)
+{
+    int chIndex{ getChIndex(ch) };
+    return static_cast<PieceKind>(chIndex < 0 ? 0 : chIndex % 7);
+}
+
+bool PieceManager::isKing(wchar_t name) { return static_cast<unsigned>(getNameIndex(name)) < 2; }
+
+bool PieceManager::isAdvisor(wchar_t name) { return static_cast<unsigned>(getNameIndex(name) - 2) < 2; }
+
+bool PieceManager::isBishop(wchar_t name) { return static_cast<unsigned>(getNameIndex(name) - 4) < 2; }
+
+bool PieceManager::isKnight(wchar_t name) { return getNameIndex(name) == 6; }
+
+bool PieceManager::isRook(wchar_t name) { return getNameIndex(name) == 7; }
+
+bool PieceManager::isCannon(wchar_t name) { return getNameIndex(name) == 8; }
+
+bool PieceManager::isStronge(wchar_t name) { return getNameIndex(name) >= 6; }
+
+bool PieceManager::isLineMove(wchar_t name) { return isKing(name) || getNameIndex(name) >= 7; }
+
+bool PieceManager::isPawn(wchar_t name) { return getNameIndex(name) >= 9; }
+
+bool PieceManager::isPiece(wchar_t name) { return getNameIndex(name) >= 0; }
+
+const wstring PieceManager::getPiecesChars() { return piecesChars; }
+
+const wstring PieceManager::getZhChars()
+{
+    return wstring{ preChars } + nameChars + movChars + numChars[static_cast<int>(PieceColor::RED)] + numChars[static_cast<int>(PieceColor::BLACK)];
+}
+
+const wstring PieceManager::getICCSChars() { return wstring{ L"0123456789" } + ICCSChars; }
+
+const wstring PieceManager::FirstFEN() { return FirstFENChars; }
+
+wchar_t PieceManager::getColICCSChar(int col) { return ICCSChars[col]; }
+
+int PieceManager::getMovNum(bool isBottom, wchar_t movChar) { return (-1 + getGlyphInfo(movChar).movIndex) * (isBottom ? 1 : -1); }
+
+wchar_t PieceManager::getMovChar(bool isSameRow, bool isBottom, bool isLowToUp) { return movChars[isSameRow ? 1 : (isBottom == isLowToUp ? 2 : 0)]; }
+
+wchar_t PieceManager::getNumChar(PieceColor color, int num) { return numChars[static_cast<int>(color)][num - 1]; }
+
+int PieceManager::getNumIndex(PieceColor color, wchar_t numChar) { return getGlyphInfo(numChar).numIndexs[static_cast<int>(color)]; }
+
+const wchar_t* PieceManager::__getPreChars(int length)
+{
+    return length == 2 ? twoPreChars : (length == 3 ? preChars : numChars[static_cast<int>(PieceColor::RED)]);
+}
+
+int PieceManager::__getPreCharIndex(int length, wchar_t preChar)
+{
+    const GlyphInfo& info{ getGlyphInfo(preChar) };
+    if (length == 2) // "前后"：无"中"
+        return (info.preIndex == 0 || info.preIndex == 2) ? info.preIndex / 2 : -1;
+    if (length == 3)
+        return info.preIndex;
+    int numIndex{ info.numIndexs[static_cast<int>(PieceColor::RED)] };
+    return numIndex < 5 ? numIndex : -1; // "一二三四五"
+}
 /* ===== PieceManager end. ===== */
 } 
\ No newline at end of file
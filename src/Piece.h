@@ -5,178 +5,114 @@
 
 namespace PieceSpace {
 
-// 棋子类
+// 棋子类：单字节值类型，空位、棋盘外均以特殊编码表示
 class Piece {
 
 public:
+    constexpr Piece()
+        : code_{ BlankCode_ }
+    {
+    }
     explicit Piece(wchar_t ch);
+    constexpr Piece(PieceColor color, PieceKind kind)
+        : code_{ static_cast<unsigned char>((color == PieceColor::BLACK ? ColorBit_ : 0) | (static_cast<int>(kind) + 1)) }
+    {
+    }
 
-    wchar_t ch() const { return ch_; }
-    wchar_t name() const { return name_; }
-    PieceColor color() const { return color_; }
-    PieceKind kind() const { return kind_; }
-    //const SSeat seat() const { return seat_.lock(); }
-
-    //void setSeat(const SSeat& seat = nullptr) { seat_ = weak_ptr<Seat>(seat); }
-    const wstring toString() const;
-
-private:
-    const wchar_t ch_;
-    const wchar_t name_;
-    const PieceColor color_;
-    const PieceKind kind_;
-};
+    static constexpr Piece offBoard() { return Piece{ OffBoardCode_ }; }
+    // 某方名称为name的棋子，名称不属于该方则为空
+    static Piece fromName(PieceColor color, wchar_t name);
 
-// 一副棋子类
-class Pieces {
+    unsigned char code() const { return code_; }
+    bool isBlank() const { return code_ == BlankCode_; }
+    bool isOffBoard() const { return code_ == OffBoardCode_; }
+    explicit operator bool() const { return code_ != BlankCode_ && code_ != OffBoardCode_; }
 
-public:
-    Pieces();
+    wchar_t ch() const;
+    wchar_t name() const;
+    PieceColor color() const { return (code_ & ColorBit_) ? PieceColor::BLACK : PieceColor::RED; }
+    PieceKind kind() const { return static_cast<PieceKind>((code_ & KindMask_) - 1); }
+    bool isStronge() const { return kind() >= PieceKind::KNIGHT; }
+    // 交换颜色后的同类棋子
+    Piece otherPiece() const { return *this ? Piece{ static_cast<unsigned char>(code_ ^ ColorBit_) } : *this; }
 
-    const SPiece& getOtherPiece(const SPiece& piece) const;
-    const vector<SPiece> getBoardPieces(const wstring& pieceChars) const;
+    bool operator==(const Piece& piece) const { return code_ == piece.code_; }
+    bool operator!=(const Piece& piece) const { return code_ != piece.code_; }
 
     const wstring toString() const;
 
 private:
-    vector<SPiece> allPieces_;
+    explicit constexpr Piece(unsigned char code)
+        : code_{ code }
+    {
+    }
+
+    static constexpr unsigned char BlankCode_{ 0 }, ColorBit_{ 0x08 }, KindMask_{ 0x07 }, OffBoardCode_{ 0x80 };
+
+    unsigned char code_;
 };
 
-// 棋子管理类
+// 棋子管理类：字符属性均由编译期生成的表查得，不分配内存
 class PieceManager {
 
 public:
-    static wchar_t getName(wchar_t ch)
-    {
-        const map<int, int> chIndex_nameIndex{
-            { 0, 0 }, { 1, 2 }, { 2, 4 }, { 3, 6 }, { 4, 7 }, { 5, 8 }, { 6, 9 },
-            { 7, 1 }, { 8, 3 }, { 9, 5 }, { 10, 6 }, { 11, 7 }, { 12, 8 }, { 13, 10 }
-        };
-        return nameChars_[chIndex_nameIndex.at(chChars_.find(ch))];
-    }
+    static wchar_t getName(wchar_t ch);
+    static wchar_t getPrintName(wchar_t ch);
 
-    static wchar_t getPrintName(wchar_t ch)
-    {
-        wchar_t name{ getName(ch) };
-        if (getColor(ch) == PieceColor::BLACK) {
-            switch (getKind(ch)) {
-            case PieceKind::ROOK:
-                name = L'車';
-                break;
-            case PieceKind::KNIGHT:
-                name = L'馬';
-                break;
-            case PieceKind::CANNON:
-                name = L'砲';
-                break;
-            default:
-                break;
-            }
-        }
-        return name;
-    }
-
-    static PieceColor getColor(wchar_t ch)
-    {
-        return islower(ch) ? PieceColor::BLACK : PieceColor::RED;
-    }
+    static PieceColor getColor(wchar_t ch) { return islower(ch) ? PieceColor::BLACK : PieceColor::RED; }
 
     static PieceColor getOtherColor(PieceColor color)
     {
         return color == PieceColor::RED ? PieceColor::BLACK : PieceColor::RED;
     }
 
-    static PieceColor getColorFromZh(wchar_t numZh)
-    {
-        return numChars_.at(PieceColor::RED).find(numZh) != wstring::npos
-            ? PieceColor::RED
-            : PieceColor::BLACK;
-    }
-
-    static PieceKind getKind(wchar_t ch)
-    {
-        static map<wchar_t, PieceKind> chKinds = {
-            { L'K', PieceKind::KING },
-            { L'A', PieceKind::ADVISOR },
-            { L'B', PieceKind::BISHOP },
-            { L'N', PieceKind::KNIGHT },
-            { L'R', PieceKind::ROOK },
-            { L'C', PieceKind::CANNON },
-            { L'P', PieceKind::PAWN }
-        };
-        return chKinds[toupper(ch)];
-    }
-
-    static bool isKing(wchar_t name) { return nameChars_.substr(0, 2).find(name) != wstring::npos; }
-
-    static bool isAdvisor(wchar_t name) { return nameChars_.substr(2, 2).find(name) != wstring::npos; }
-
-    static bool isBishop(wchar_t name) { return nameChars_.substr(4, 2).find(name) != wstring::npos; }
-
-    static bool isKnight(wchar_t name) { return nameChars_[6] == name; }
-
-    static bool isRook(wchar_t name) { return nameChars_[7] == name; }
-
-    static bool isCannon(wchar_t name) { return nameChars_[8] == name; }
-
-    static bool isStronge(wchar_t name) { return nameChars_.substr(6, 5).find(name) != wstring::npos; }
-
-    static bool isLineMove(wchar_t name) { return isKing(name) || nameChars_.substr(7, 4).find(name) != wstring::npos; }
-
-    static bool isPawn(wchar_t name) { return nameChars_.substr(nameChars_.size() - 2, 2).find(name) != wstring::npos; }
-
-    static bool isPiece(wchar_t name) { return nameChars_.find(name) != wstring::npos; }
-
-    static const wstring getPiecesChars() { return piecesChar_; }
-
-    static const wstring getZhChars() { return (preChars_ + nameChars_ + movChars_ + numChars_.at(PieceColor::RED) + numChars_.at(PieceColor::BLACK)); }
-
-    static const wstring getICCSChars() { return wstring(L"0123456789") + ICCSChars_; }
-
-    static const wstring FirstFEN() { return FirstFEN_; }
+    static PieceColor getColorFromZh(wchar_t numZh);
+    static PieceKind getKind(wchar_t ch);
+
+    static bool isKing(wchar_t name);
+    static bool isAdvisor(wchar_t name);
+    static bool isBishop(wchar_t name);
+    static bool isKnight(wchar_t name);
+    static bool isRook(wchar_t name);
+    static bool isCannon(wchar_t name);
+    static bool isStronge(wchar_t name);
+    static bool isLineMove(wchar_t name);
+    static bool isPawn(wchar_t name);
+    static bool isPiece(wchar_t name);
+
+    static const wstring getPiecesChars();
+    static const wstring getZhChars();
+    static const wstring getICCSChars();
+    static const wstring FirstFEN();
 
     static int getRowFromICCSChar(wchar_t ch) { return ch - '0'; } // 0:48
 
-    static int getColFromICCSChar(wchar_t ch) { return ICCSChars_.find(ch); }
+    static int getColFromICCSChar(wchar_t ch) { return (ch >= L'a' && ch <= L'i') ? ch - L'a' : -1; }
 
-    static wchar_t getColICCSChar(int col) { return ICCSChars_[col]; }
+    static wchar_t getColICCSChar(int col);
 
     static wchar_t nullChar() { return nullChar_; };
 
     // 宽字符与数字序号的转换
-    static int getMovNum(bool isBottom, wchar_t movChar) { return (-1 + movChars_.find(movChar)) * (isBottom ? 1 : -1); }
-
-    static wchar_t getMovChar(bool isSameRow, bool isBottom, bool isLowToUp) { return movChars_[isSameRow ? 1 : (isBottom == isLowToUp ? 2 : 0)]; }
-
-    static wchar_t getNumChar(PieceColor color, int num) { return numChars_.at(color)[num - 1]; }
-
-    static int getNumIndex(PieceColor color, wchar_t numChar) { return 0 + numChars_.at(color).find(numChar); }
+    static int getMovNum(bool isBottom, wchar_t movChar);
+    static wchar_t getMovChar(bool isSameRow, bool isBottom, bool isLowToUp);
+    static wchar_t getNumChar(PieceColor color, int num);
+    static int getNumIndex(PieceColor color, wchar_t numChar);
 
     static int getCurIndex(bool isBottom, int index, int len) { return isBottom ? len - 1 - index : index; }
 
-    static int getPreIndex(int seatsLen, bool isBottom, wchar_t preChar) { return getCurIndex(isBottom, __getPreChars(seatsLen).find(preChar), seatsLen); }
+    static int getPreIndex(int seatsLen, bool isBottom, wchar_t preChar) { return getCurIndex(isBottom, __getPreCharIndex(seatsLen, preChar), seatsLen); }
 
     static wchar_t getPreChar(int seatsLen, bool isBottom, int index) { return __getPreChars(seatsLen)[getCurIndex(isBottom, index, seatsLen)]; }
 
-    static wchar_t getColChar(PieceColor color, bool isBottom, int colIndex) { return numChars_.at(color)[getCurIndex(isBottom, colIndex, BOARDCOLNUM)]; }
+    static wchar_t getColChar(PieceColor color, bool isBottom, int colIndex) { return getNumChar(color, getCurIndex(isBottom, colIndex, BOARDCOLNUM) + 1); }
 
 private:
-    static const wstring __getPreChars(int length)
-    {
-        return (length == 2 ? (wstring{ preChars_ }).erase(1, 1) //L"前后"
-                            : (length == 3 ? preChars_ //L"前中后"
-                                           : numChars_.at(PieceColor::RED).substr(0, 5))); //L"一二三四五");
-    }
+    // 同列棋子的前后标识：2个为"前后"，3个为"前中后"，更多为"一二三四五"
+    static const wchar_t* __getPreChars(int length);
+    static int __getPreCharIndex(int length, wchar_t preChar);
 
-    static const wstring piecesChar_;
-    static const wstring chChars_;
-    static const wstring preChars_;
-    static const wstring nameChars_;
-    static const wstring movChars_;
-    static const map<PieceColor, wstring> numChars_;
     static constexpr wchar_t nullChar_{ L'_' };
-    static const wstring ICCSChars_;
-    static const wstring FirstFEN_;
 };
 }
 
@@ -1,94 +1,155 @@
-#include "Seat.h"
-#include "Piece.h"
+﻿#include "Seat.h"
 
 namespace SeatSpace {
 
-/* ===== Seat start. ===== */
-Seat::Seat(int row, int col)
-    : row_{ row }
-    , col_{ col }
+// 编译期生成的走法表：表序号 = isBottom * 90 + 行 * 9 + 列，
+// 每项按原候选次序保存该位置有效的目标位置（马、象含马腿、象眼位置）
+template <typename T, int N>
+struct SeatTargets {
+    T items[N];
+    int size;
+};
+
+// 候选函数cand(tableIndex, k)返回第k个候选位置及其是否有效
+template <typename T, int N, typename Cand>
+constexpr T getValidTarget(Cand cand, int tableIndex, int no)
 {
+    for (int k = 0, count = 0; k != N; ++k)
+        if (cand(tableIndex, k).second && count++ == no)
+            return cand(tableIndex, k).first;
+    return T{};
 }
 
-bool Seat::isSameColor(const SSeat& seat) const
+template <int N, typename Cand>
+constexpr int getValidCount(Cand cand, int tableIndex)
 {
-    auto& piece = seat->piece();
-    return piece && piece->color() == piece_->color();
+    int count{ 0 };
+    for (int k = 0; k != N; ++k)
+        count += cand(tableIndex, k).second;
+    return count;
 }
 
-const SPiece Seat::movTo(const SSeat& tseat, const SPiece& eatPiece) const
+template <typename T, int N, typename Cand, size_t... No>
+constexpr SeatTargets<T, N> makeSeatTargets(Cand cand, int tableIndex, index_sequence<No...>)
 {
-    auto tpiece = tseat->piece();
-    tseat->setPiece(this->piece());
-    setPiece(eatPiece);
-    return tpiece;
+    return { { getValidTarget<T, N>(cand, tableIndex, No)... }, getValidCount<N>(cand, tableIndex) };
 }
 
-const wstring Seat::toString() const
+template <typename T, int N, typename Cand, size_t... TableIndex>
+constexpr array<SeatTargets<T, N>, sizeof...(TableIndex)> makeTargetsTable(Cand cand, index_sequence<TableIndex...>)
 {
-    wostringstream wos{};
-    wos << row_ << col_ << L'&' << (piece_ ? piece_->name() : L'_'); //<< boolalpha << setw(2) <<
-    return wos.str();
+    return { { makeSeatTargets<T, N>(cand, TableIndex, make_index_sequence<N>{})... } };
 }
-/* ===== Seat end. ===== */
 
-/* ===== Seats start. ===== */
-Seats::Seats()
+constexpr bool isBottomIndex(int tableIndex) { return tableIndex >= SEATNUM; }
+constexpr int getTableRow(int tableIndex) { return tableIndex % SEATNUM / BOARDCOLNUM; }
+constexpr int getTableCol(int tableIndex) { return tableIndex % BOARDCOLNUM; }
+constexpr bool isBoardRowCol(int row, int col) { return row >= 0 && row < BOARDROWNUM && col >= 0 && col < BOARDCOLNUM; }
+constexpr bool isPalaceRowCol(bool isBottom, int row, int col)
 {
-    for (auto& rowcol_pair : SeatManager::getAllRowCols())
-        allSeats_.push_back(make_shared<Seat>(rowcol_pair.first, rowcol_pair.second));
+    return (isBottom ? row >= 0 && row <= 2 : row >= 7 && row <= 9) && col >= 3 && col <= 5;
 }
 
-inline const SSeat& Seats::getSeat(int row, int col) const
+// 四个相邻、斜向相邻、象步及马步的行列偏移
+constexpr int lineOffsets[4][2]{ { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 } };
+constexpr int diagOffsets[4][2]{ { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 } };
+constexpr int knightOffsets[8][4]{ // 马腿行、列偏移，目标行、列偏移
+    { -1, 0, -2, -1 }, { -1, 0, -2, 1 }, { 0, -1, -1, -2 }, { 0, 1, -1, 2 },
+    { 0, -1, 1, -2 }, { 0, 1, 1, 2 }, { 1, 0, 2, -1 }, { 1, 0, 2, 1 }
+};
+
+constexpr auto kingTargets = makeTargetsTable<RowCol_pair, 4>(
+    [](int tableIndex, int k) {
+        int row{ getTableRow(tableIndex) + lineOffsets[k][0] }, col{ getTableCol(tableIndex) + lineOffsets[k][1] };
+        return make_pair(make_pair(row, col), isPalaceRowCol(isBottomIndex(tableIndex), row, col));
+    },
+    make_index_sequence<2 * SEATNUM>{});
+
+constexpr auto advisorTargets = makeTargetsTable<RowCol_pair, 4>(
+    [](int tableIndex, int k) {
+        int row{ getTableRow(tableIndex) + diagOffsets[k][0] }, col{ getTableCol(tableIndex) + diagOffsets[k][1] };
+        return make_pair(make_pair(row, col), isPalaceRowCol(isBottomIndex(tableIndex), row, col));
+    },
+    make_index_sequence<2 * SEATNUM>{});
+
+constexpr auto bishopTargets = makeTargetsTable<PRowCol_pair, 4>(
+    [](int tableIndex, int k) {
+        int frow{ getTableRow(tableIndex) }, fcol{ getTableCol(tableIndex) },
+            row{ frow + 2 * diagOffsets[k][0] }, col{ fcol + 2 * diagOffsets[k][1] };
+        bool isBottom{ isBottomIndex(tableIndex) };
+        return make_pair(make_pair(make_pair(frow + diagOffsets[k][0], fcol + diagOffsets[k][1]), make_pair(row, col)),
+            isBoardRowCol(row, col) && (isBottom ? row <= 4 : row >= 5));
+    },
+    make_index_sequence<2 * SEATNUM>{});
+
+constexpr auto knightTargets = makeTargetsTable<PRowCol_pair, 8>(
+    [](int tableIndex, int k) {
+        int frow{ getTableRow(tableIndex) }, fcol{ getTableCol(tableIndex) },
+            row{ frow + knightOffsets[k][2] }, col{ fcol + knightOffsets[k][3] };
+        return make_pair(make_pair(make_pair(frow + knightOffsets[k][0], fcol + knightOffsets[k][1]), make_pair(row, col)),
+            isBoardRowCol(row, col));
+    },
+    make_index_sequence<2 * SEATNUM>{});
+
+constexpr auto pawnTargets = makeTargetsTable<RowCol_pair, 3>(
+    [](int tableIndex, int k) {
+        bool isBottom{ isBottomIndex(tableIndex) };
+        int frow{ getTableRow(tableIndex) }, fcol{ getTableCol(tableIndex) },
+            row{ k == 0 ? frow + (isBottom ? 1 : -1) : frow }, col{ k == 0 ? fcol : fcol + (k == 1 ? -1 : 1) };
+        return make_pair(make_pair(row, col),
+            isBoardRowCol(row, col) && (k == 0 || isBottom == (frow > 4))); // 兵已过河才可横走
+    },
+    make_index_sequence<2 * SEATNUM>{});
+
+/* ===== MoveCode start. ===== */
+MoveCode::MoveCode(const PRowCol_pair& prowcol_pair)
+    : MoveCode{ SeatManager::getIndex_rc(prowcol_pair.first.first, prowcol_pair.first.second),
+        SeatManager::getIndex_rc(prowcol_pair.second.first, prowcol_pair.second.second) }
 {
-    return allSeats_.at(SeatManager::getIndex_rc(row, col));
 }
 
-inline const SSeat& Seats::getSeat(RowCol_pair rowcol_pair) const
+PRowCol_pair MoveCode::getPRowCol_pair() const
 {
-    return getSeat(rowcol_pair.first, rowcol_pair.second);
+    int fromIndex{ findex() }, toIndex{ tindex() };
+    return make_pair(make_pair(fromIndex / BOARDCOLNUM, fromIndex % BOARDCOLNUM),
+        make_pair(toIndex / BOARDCOLNUM, toIndex % BOARDCOLNUM));
 }
+/* ===== MoveCode end. ===== */
 
-PieceColor Seats::getSideColor(bool isBottom) const { return __getKingSeat(isBottom)->piece()->color(); }
+/* ===== Seats start. ===== */
+Seats::Seats()
+{
+    for (Seat seat = 0; seat != SEATPADNUM; ++seat)
+        pieces_[seat] = SeatManager::isOnBoard(seat) ? Piece{} : Piece::offBoard();
+}
+
+Piece Seats::getPiece(int row, int col) const
+{
+    return pieces_[SeatManager::getSeat(row, col)];
+}
+
+PieceColor Seats::getSideColor(bool isBottom) const { return pieces_[__getKingSeat(isBottom)].color(); }
 
 bool Seats::isKilled(PieceColor bottomColor, PieceColor color) const
 {
-    bool isBottom = bottomColor == color;
-    auto &kingSeat{ __getKingSeat(isBottom) }, &otherSeat{ __getKingSeat(!isBottom) };
-    int kcol{ kingSeat->col() };
-    if (kcol == otherSeat->col()) {
-        int krow{ kingSeat->row() }, orow{ otherSeat->row() },
-            lrow{ isBottom ? krow : orow }, urow{ isBottom ? orow : krow };
-        bool killed{ true };
-        for (int row = lrow + 1; row < urow; ++row)
-            if (getSeat(row, kcol)->piece()) { // 有棋子
-                killed = false;
-                break;
-            }
-        if (killed)
-            return true; // 全部是空棋子，则将帅对面
-    }
-    // '获取某方可杀将棋子全部可走的位置
-    for (const auto& lseat : __getLiveSeats(PieceManager::getOtherColor(color), BLANKNAME, BLANKCOL, true)) {
-        auto mseats = __getMoveSeats(bottomColor, lseat->rowCol_pair());
-        if (!mseats.empty() && find(mseats.begin(), mseats.end(), kingSeat) != mseats.end()) // 对方强子可走位置有本将位置
-            return true;
-    }
-    return false;
+    return bitboards_.isKilled(bottomColor, color);
 }
 
 bool Seats::isDied(PieceColor bottomColor, PieceColor color) const
 {
-    for (const auto& fseat : __getLiveSeats(color))
-        if (!__getCanMoveSeats(bottomColor, fseat->rowCol_pair()).empty()) // 本方还有棋子可以走
+    KingSafety safety{ bitboards_.getKingSafety(bottomColor, color) };
+    for (Bitboard bb{ bitboards_.getPieces(color) }; bb;) {
+        int index{ bb.popLsb() };
+        if (bitboards_.getLegalMoves(bottomColor, index, pieces_[SeatManager::getSeatFromIndex(index)], safety)) // 本方还有棋子可以走
             return false;
+    }
     return true;
 }
 
-RowCol_pair_vector Seats::getPutRowCols(PieceColor sideColor, const SPiece& piece) const
+RowCol_pair_vector Seats::getPutRowCols(PieceColor sideColor, Piece piece) const
 {
-    bool isBottom = sideColor == piece->color();
-    switch (piece->kind()) {
+    bool isBottom = sideColor == piece.color();
+    switch (piece.kind()) {
     case PieceKind::KING:
         return SeatManager::getKingRowCols(isBottom);
     case PieceKind::ADVISOR:
@@ -105,7 +166,27 @@ RowCol_pair_vector Seats::getPutRowCols(PieceColor sideColor, const SPiece& piec
 
 RowCol_pair_vector Seats::getCanMoveRowCols(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const
 {
-    return __getRowCols(__getCanMoveSeats(bottomColor, rowcol_pair));
+    return __getRowCols(__getCanMoveSeats(bottomColor, SeatManager::getSeat(rowcol_pair)));
+}
+
+void Seats::generateLegalMoves(PieceColor bottomColor, PieceColor color, MoveList& moveList) const
+{
+    moveList.clear();
+    KingSafety safety{ bitboards_.getKingSafety(bottomColor, color) };
+    for (Bitboard bb{ bitboards_.getPieces(color) }; bb;) {
+        int findex{ bb.popLsb() };
+        for (Bitboard moves{ bitboards_.getLegalMoves(bottomColor, findex, pieces_[SeatManager::getSeatFromIndex(findex)], safety) }; moves;)
+            moveList.push_back(MoveCode{ findex, moves.popLsb() });
+    }
+}
+
+bool Seats::isCanMove(PieceColor bottomColor, MoveCode moveCode) const
+{
+    int findex{ moveCode.findex() };
+    Piece piece{ pieces_[SeatManager::getSeatFromIndex(findex)] };
+    if (!piece)
+        return false;
+    return bitboards_.getLegalMoves(bottomColor, findex, piece, bitboards_.getKingSafety(bottomColor, piece.color())).test(moveCode.tindex());
 }
 
 RowCol_pair_vector Seats::getLiveRowCols(PieceColor color, wchar_t name, int col, bool getStronge) const
@@ -117,7 +198,7 @@ PRowCol_pair Seats::getPRowCol_pair(PieceColor sideColor, const wstring& str) co
 {
     assert(str.size() == 4);
     RowCol_pair frowcol_pair, trowcol_pair;
-    SSeat_vector seats;
+    Seat_vector seats;
     // 根据最后一个字符判断该着法属于哪一方
     PieceColor color{ PieceManager::getColorFromZh(str.back()) };
     bool isBottom{ sideColor == color };
@@ -139,11 +220,8 @@ PRowCol_pair Seats::getPRowCol_pair(PieceColor sideColor, const wstring& str) co
         index = PieceManager::getPreIndex(seats.size(), isBottom, str.front());
     }
 
-    //wcout << __LINE__ << L':' << getRowColsStr(__getRowCols(seats)) << endl;
     assert(seats.size() - index >= 1);
-    //wcout << __LINE__ << L':' << getRowColsStr(__getRowCols(seats)) << endl;
-
-    frowcol_pair = seats.at(index)->rowCol_pair();
+    frowcol_pair = SeatManager::getSeatRowCol_pair(seats.at(index));
 
     int numIndex{ PieceManager::getNumIndex(color, str.back()) },
         toCol{ PieceManager::getCurIndex(isBottom, numIndex, BOARDCOLNUM) };
@@ -166,22 +244,15 @@ PRowCol_pair Seats::getPRowCol_pair(PieceColor sideColor, const wstring& str) co
 const wstring Seats::getZHStr(PieceColor sideColor, PRowCol_pair prowcol_pair) const
 {
     wstring wstr{};
-    auto& fseat = getSeat(prowcol_pair.first);
-    const SPiece& fromPiece{ fseat->piece() };
-    /*
-    wcout << __LINE__ << L':' << setfill(L'0') << setw(2) << SeatManager::getRowCol(prowcol_pair.first) << L'-'
-          << setw(2) << SeatManager::getRowCol(prowcol_pair.second)
-          << L' ' << (fromPiece ? fromPiece->toString() : L"--") << L'\n';
-    //*/
-
+    Seat fseat{ SeatManager::getSeat(prowcol_pair.first) };
+    Piece fromPiece{ pieces_[fseat] };
     assert(fromPiece);
-    PieceColor color{ fromPiece->color() };
-    wchar_t name{ fromPiece->name() };
+    PieceColor color{ fromPiece.color() };
+    wchar_t name{ fromPiece.name() };
     int fromRow{ prowcol_pair.first.first }, fromCol{ prowcol_pair.first.second },
         toRow{ prowcol_pair.second.first }, toCol{ prowcol_pair.second.second };
     bool isSameRow{ fromRow == toRow }, isBottom{ sideColor == color };
     auto seats = __getLiveSeats(color, name, fromCol);
-    //*
 
     if (seats.size() > 1 && PieceManager::isStronge(name)) {
         if (PieceManager::isPawn(name))
@@ -198,235 +269,213 @@ const wstring Seats::getZHStr(PieceColor sideColor, PRowCol_pair prowcol_pair) c
             ? PieceManager::getNumChar(color, abs(fromRow - toRow)) // 非同一行
             : PieceManager::getColChar(color, isBottom, toCol));
 
-    //*/
     //assert(getPRowCol_pair(sideColor, wstr) == prowcol_pair);
     return wstr;
 }
 
-const SPiece Seats::doneMove(PRowCol_pair prowcol_pair) const
+Piece Seats::doneMove(MoveCode moveCode)
 {
-    return getSeat(prowcol_pair.first)->movTo(getSeat(prowcol_pair.second));
+    return __movTo(SeatManager::getSeatFromIndex(moveCode.findex()), SeatManager::getSeatFromIndex(moveCode.tindex()));
 }
 
-void Seats::undoMove(PRowCol_pair prowcol_pair, const SPiece& eatPie) const
+void Seats::undoMove(MoveCode moveCode, Piece eatPie)
 {
-    getSeat(prowcol_pair.second)->movTo(getSeat(prowcol_pair.first), eatPie);
+    __movTo(SeatManager::getSeatFromIndex(moveCode.tindex()), SeatManager::getSeatFromIndex(moveCode.findex()), eatPie);
 }
 
-void Seats::setBoardPieces(const vector<SPiece>& boardPieces)
+void Seats::setBoardPieces(const wstring& pieceChars)
 {
+    bool isValid{ pieceChars.size() == SEATNUM };
     int index{ 0 };
-    for_each(allSeats_.begin(), allSeats_.end(),
-        [&](const SSeat& seat) { seat->setPiece(boardPieces[index++]); });
+    for (int row = 0; row < BOARDROWNUM; ++row)
+        for (int col = 0; col < BOARDCOLNUM; ++col, ++index)
+            pieces_[SeatManager::getSeat(row, col)] = isValid ? Piece{ pieceChars[index] } : Piece{};
+    __resetBitboards();
+}
+
+void Seats::setFEN(const wstring& fen)
+{
+    // 由最高行起逐行、逐列放置，各行以'/'分隔，数字为连续空位数
+    Piece boardPieces[SEATNUM]{};
+    int row{ BOARDROWNUM - 1 }, col{ 0 };
+    for (auto wch : fen) {
+        if (wch == L' ')
+            break;
+        if (wch == L'/') {
+            if (col != BOARDCOLNUM || row == 0)
+                throw runtime_error("FEN格式错误：行数或列数不符!");
+            --row;
+            col = 0;
+        } else if (wch >= L'1' && wch <= L'9') {
+            if ((col += wch - L'0') > BOARDCOLNUM)
+                throw runtime_error("FEN格式错误：列数超出!");
+        } else {
+            Piece piece{ wch };
+            if (!piece || col == BOARDCOLNUM)
+                throw runtime_error("FEN格式错误：棋子字符无效或列数超出!");
+            boardPieces[SeatManager::getIndex_rc(row, col++)] = piece;
+        }
+    }
+    if (row != 0 || col != BOARDCOLNUM)
+        throw runtime_error("FEN格式错误：行数或列数不符!");
+
+    for (int index = 0; index != SEATNUM; ++index)
+        pieces_[SeatManager::getSeatFromIndex(index)] = boardPieces[index];
+    __resetBitboards();
+}
+
+const wstring Seats::getFEN() const
+{
+    wstring fen{};
+    fen.reserve(SEATNUM + BOARDROWNUM);
+    for (int row = BOARDROWNUM - 1; row >= 0; --row) {
+        int num{ 0 };
+        for (int col = 0; col != BOARDCOLNUM; ++col) {
+            Piece piece{ pieces_[SeatManager::getSeat(row, col)] };
+            if (!piece)
+                ++num;
+            else {
+                if (num)
+                    fen += static_cast<wchar_t>(L'0' + num);
+                num = 0;
+                fen += piece.ch();
+            }
+        }
+        if (num)
+            fen += static_cast<wchar_t>(L'0' + num);
+        if (row)
+            fen += L'/';
+    }
+    return fen;
 }
 
-void Seats::changeSide(const ChangeType ct, const shared_ptr<Pieces>& pieces)
+void Seats::changeSide(const ChangeType ct)
 {
-    vector<SPiece> boardPieces{};
+    Piece boardPieces[SEATPADNUM];
+    copy(begin(pieces_), end(pieces_), begin(boardPieces));
     auto changeRowcol = (ct == ChangeType::ROTATE ? &SeatManager::getRotate : &SeatManager::getSymmetry);
-    for_each(allSeats_.begin(), allSeats_.end(),
-        [&](const SSeat& seat) {
-            boardPieces.push_back(ct == ChangeType::EXCHANGE
-                    ? pieces->getOtherPiece(seat->piece())
-                    : getSeat(changeRowcol(seat->rowCol_pair()))->piece());
-        });
-    setBoardPieces(boardPieces);
+    for (auto& rowcol_pair : SeatManager::getAllRowCols()) {
+        Seat seat{ SeatManager::getSeat(rowcol_pair) };
+        pieces_[seat] = (ct == ChangeType::EXCHANGE
+                ? boardPieces[seat].otherPiece()
+                : boardPieces[SeatManager::getSeat(changeRowcol(rowcol_pair))]);
+    }
+    __resetBitboards();
 }
 
 const wstring Seats::getPieceChars() const
 {
-    wostringstream wos{};
-    for_each(allSeats_.begin(), allSeats_.end(),
-        [&](const SSeat& seat) {
-            wos << (seat->piece() ? seat->piece()->ch() : PieceManager::nullChar());
-        });
-    return wos.str();
+    wstring pieceChars(SEATNUM, PieceManager::nullChar());
+    int index{ 0 };
+    for (int row = 0; row < BOARDROWNUM; ++row)
+        for (int col = 0; col < BOARDCOLNUM; ++col, ++index) {
+            Piece piece{ pieces_[SeatManager::getSeat(row, col)] };
+            if (piece)
+                pieceChars[index] = piece.ch();
+        }
+    return pieceChars;
 }
 
 const wstring Seats::toString() const
 {
     wostringstream wos{};
-    for_each(allSeats_.begin(), allSeats_.end(),
-        [&](const SSeat& seat) {
-            wos << seat->toString() << L' ';
-        });
+    for (int row = 0; row < BOARDROWNUM; ++row)
+        for (int col = 0; col < BOARDCOLNUM; ++col) {
+            Piece piece{ pieces_[SeatManager::getSeat(row, col)] };
+            wos << row << col << L'&' << (piece ? piece.name() : L'_') << L' ';
+        }
     return wos.str();
 }
 
-const SSeat& Seats::__getKingSeat(bool isBottom) const
+Seat Seats::__getKingSeat(bool isBottom) const
 {
-    for (auto& rowcol_pair : SeatManager::getKingRowCols(isBottom)) {
-        auto& seat = getSeat(rowcol_pair);
-        auto& piece = seat->piece();
-        if (piece && PieceManager::isKing(piece->name()))
-            return seat;
+    for (auto color : { PieceColor::RED, PieceColor::BLACK }) {
+        Bitboard king{ bitboards_.getPieces(color, PieceKind::KING) };
+        if (king && SeatManager::isBottom(BitboardManager::getRow(king.lsb())) == isBottom)
+            return SeatManager::getSeatFromIndex(king.lsb());
     }
     throw runtime_error("将（帅）不在棋盘上面!");
 }
 
-RowCol_pair_vector Seats::__getRowCols(const SSeat_vector& seats) const
+Piece Seats::__movTo(Seat fseat, Seat tseat, Piece eatPiece)
 {
-    RowCol_pair_vector rowcol_pv{};
-    for (auto& seat : seats)
-        rowcol_pv.push_back(seat->rowCol_pair());
-    return rowcol_pv;
+    Piece fpiece{ pieces_[fseat] }, tpiece{ pieces_[tseat] };
+    assert(fpiece); // 起点无棋子的着法应在读取时拒绝
+    int findex{ SeatManager::getIndex(fseat) }, tindex{ SeatManager::getIndex(tseat) };
+    if (tpiece)
+        bitboards_.togglePiece(tindex, tpiece);
+    if (fpiece) { // 空白棋子无位棋盘，不能异或
+        bitboards_.togglePiece(findex, fpiece);
+        bitboards_.togglePiece(tindex, fpiece);
+    }
+    if (eatPiece)
+        bitboards_.togglePiece(findex, eatPiece);
+
+    pieces_[tseat] = fpiece;
+    pieces_[fseat] = eatPiece;
+    return tpiece;
 }
 
-SSeat_vector Seats::__getSeats(const RowCol_pair_vector& rowcol_pv) const
+void Seats::__resetBitboards()
 {
-    SSeat_vector seats{};
-    for (auto& rowcol_p : rowcol_pv)
-        seats.push_back(getSeat(rowcol_p));
-    return seats;
+    bitboards_.clear();
+    for (int index = 0; index != SEATNUM; ++index) {
+        Piece piece{ pieces_[SeatManager::getSeatFromIndex(index)] };
+        if (piece)
+            bitboards_.togglePiece(index, piece);
+    }
 }
 
-SSeat_vector Seats::__getMoveSeats(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const
+RowCol_pair_vector Seats::__getRowCols(const Seat_vector& seats) const
 {
-    auto& fseat = getSeat(rowcol_pair);
-    auto& piece = fseat->piece();
-    assert(fseat->piece());
-    bool isBottom = bottomColor == piece->color();
-    SSeat_vector seats;
-    switch (piece->kind()) {
-    case PieceKind::ROOK:
-        seats = __getRook_MoveSeats(fseat);
-        break;
-    case PieceKind::CANNON:
-        seats = __getCannon_MoveSeats(fseat);
-        break;
-    case PieceKind::KNIGHT:
-        seats = __getSeats(__getNonObs_MoveRowCols(isBottom, rowcol_pair, &SeatManager::getKnightObs_MoveRowCols));
-        break;
-    case PieceKind::BISHOP:
-        seats = __getSeats(__getNonObs_MoveRowCols(isBottom, rowcol_pair, &SeatManager::getBishopObs_MoveRowCols));
-        break;
-    case PieceKind::PAWN:
-        seats = __getSeats(SeatManager::getPawnMoveRowCols(isBottom, rowcol_pair));
-        break;
-    case PieceKind::ADVISOR:
-        seats = __getSeats(SeatManager::getAdvisorMoveRowCols(isBottom, rowcol_pair));
-        break;
-    case PieceKind::KING:
-        seats = __getSeats(SeatManager::getKingMoveRowCols(isBottom, rowcol_pair));
-        break;
-    default:
-        break;
-    };
-
-    auto pos = remove_if(seats.begin(), seats.end(),
-        [&](const SSeat& tseat) {
-            return fseat->isSameColor(tseat); // 非同一颜色
-        });
-    return SSeat_vector(seats.begin(), pos);
+    RowCol_pair_vector rowcol_pv{};
+    for (Seat seat : seats)
+        rowcol_pv.push_back(SeatManager::getSeatRowCol_pair(seat));
+    return rowcol_pv;
 }
 
-SSeat_vector Seats::__getCanMoveSeats(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const
+Seat_vector Seats::__getCanMoveSeats(PieceColor bottomColor, Seat fseat) const
 {
     // 该位置需有棋子，由调用者board来保证
-    //wcout << __LINE__ << L":" << setfill(L'0') << setw(2) << SeatManager::getRowCol(rowcol_pair) << endl;
-    auto mseats = __getMoveSeats(bottomColor, rowcol_pair);
-    //wcout << __LINE__ << L":" << fseat->toString() << endl;
-
-    auto& fseat = getSeat(rowcol_pair);
-    auto color = fseat->piece()->color();
-    auto pos = remove_if(mseats.begin(), mseats.end(),
-        [&](const SSeat& tseat) {
-            // 移动棋子后，检测是否会被对方将军
-            auto eatPiece = fseat->movTo(tseat);
-            bool killed{ isKilled(bottomColor, color) };
-            tseat->movTo(fseat, eatPiece);
-            return killed;
-        });
-    return SSeat_vector{ mseats.begin(), pos };
-}
-
-SSeat_vector Seats::__getLiveSeats(PieceColor color, wchar_t name, int col, bool getStronge) const
-{
-    SSeat_vector seats{};
-    for (auto& seat : allSeats_) {
-        auto& piece = seat->piece();
-        if (piece && color == piece->color()
-            && (name == BLANKNAME || name == piece->name())
-            && (col == BLANKCOL || col == seat->col())
-            && (!getStronge || PieceManager::isStronge(piece->name())))
-            seats.push_back(seat);
-    }
+    Piece piece{ pieces_[fseat] };
+    assert(piece);
+    int findex{ SeatManager::getIndex(fseat) };
+    Seat_vector seats{};
+    for (Bitboard bb{ bitboards_.getLegalMoves(bottomColor, findex, piece, bitboards_.getKingSafety(bottomColor, piece.color())) }; bb;)
+        seats.push_back(SeatManager::getSeatFromIndex(bb.popLsb()));
     return seats;
 }
 
-SSeat_vector Seats::__getSortPawnLiveSeats(bool isBottom, PieceColor color, wchar_t name) const
-{
-    // 最多5个兵
-    SSeat_vector pawnSeats{ __getLiveSeats(color, name) }, seats{};
-    // 按列建立字典，按列排序
-    map<int, SSeat_vector> colSeats{};
-    int order = (isBottom ? -1 : 1); // isBottom则列倒序,每列位置倒序
-    for_each(pawnSeats.begin(), pawnSeats.end(),
-        [&](const SSeat& seat) {
-            colSeats[order * seat->col()].push_back(seat);
-        });
-
-    // 整合成一个数组
-    for (auto& colseat_pv : colSeats) {
-        auto& seat_v = colseat_pv.second;
-        if (seat_v.size() > 1) { // 筛除只有一个位置的列
-            if (isBottom)
-                reverse(seat_v.begin(), seat_v.end());
-            copy(seat_v.begin(), seat_v.end(), back_inserter(seats)); //按列存入
-        }
+Seat_vector Seats::__getLiveSeats(PieceColor color, wchar_t name, int col, bool getStronge) const
+{
+    // 由按颜色、种类记录的位棋盘（随走子增量更新）取得，按行、列顺序排列
+    Bitboard bb{ bitboards_.getPieces(color) };
+    if (name != BLANKNAME) {
+        Piece piece{ Piece::fromName(color, name) };
+        bb = piece ? bitboards_.getPieces(color, piece.kind()) : Bitboard{};
     }
+    if (col != BLANKCOL)
+        bb &= BitboardManager::getFile(col);
+    if (getStronge)
+        bb &= bitboards_.getStrongePieces(color);
+
+    Seat_vector seats{};
+    while (bb)
+        seats.push_back(SeatManager::getSeatFromIndex(bb.popLsb()));
     return seats;
 }
 
-RowCol_pair_vector Seats::__getNonObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair,
-    PRowCol_pair_vector (*getObs_MoveRowCols)(bool, const RowCol_pair&)) const
-{
-    RowCol_pair_vector rowcol_pv{};
-    auto obs_MoveRowCols = getObs_MoveRowCols(isBottom, rowcol_pair);
-    for_each(obs_MoveRowCols.begin(), obs_MoveRowCols.end(),
-        [&](const PRowCol_pair& obs_Moverowcol) {
-            if (!getSeat(obs_Moverowcol.first)->piece()) // 该位置无棋子
-                rowcol_pv.push_back(obs_Moverowcol.second);
-        });
-    return rowcol_pv;
-}
-
-SSeat_vector Seats::__getRook_MoveSeats(const SSeat& fseat) const
+Seat_vector Seats::__getSortPawnLiveSeats(bool isBottom, PieceColor color, wchar_t name) const
 {
-    SSeat_vector seats{};
-    for (auto& rowcolpair_Line : SeatManager::getRookCannonMoveRowCol_Lines(fseat->rowCol_pair()))
-        for (auto& rowcol_pair : rowcolpair_Line) {
-            auto& tseat = getSeat(rowcol_pair);
-            if (tseat->piece()) { // 该位置有棋子
-                if (!fseat->isSameColor(tseat)) // 非同一颜色
-                    seats.push_back(tseat);
-                break;
-            } else
-                seats.push_back(tseat);
-        }
-    return seats;
-}
-
-SSeat_vector
-Seats::__getCannon_MoveSeats(const SSeat& fseat) const
-{
-    SSeat_vector seats{};
-    for (auto& rowcolpair_Line : SeatManager::getRookCannonMoveRowCol_Lines(fseat->rowCol_pair())) {
-        bool isSkip = false; // 是否已跳棋子的标志
-        for (auto rowcol_pair : rowcolpair_Line) {
-            auto& tseat = getSeat(rowcol_pair);
-            auto& piece = tseat->piece();
-            if (!isSkip) {
-                if (!piece) // 该位置无棋子
-                    seats.push_back(tseat);
-                else
-                    isSkip = true;
-            } else if (piece) { // 该位置有棋子
-                if (!fseat->isSameColor(tseat)) // 非同一颜色
-                    seats.push_back(tseat);
-                break;
-            }
-        }
+    // 最多5个兵：按列排序，筛除只有一个兵的列；isBottom则列倒序,每列位置倒序
+    Piece piece{ Piece::fromName(color, name) };
+    Bitboard pawns{ piece ? bitboards_.getPieces(color, piece.kind()) : Bitboard{} };
+    Seat_vector seats{};
+    for (int index = 0; index != BOARDCOLNUM; ++index) {
+        Bitboard colPawns{ pawns & BitboardManager::getFile(isBottom ? BOARDCOLNUM - 1 - index : index) };
+        if (colPawns.count() > 1)
+            while (colPawns)
+                seats.push_back(SeatManager::getSeatFromIndex(isBottom ? colPawns.popMsb() : colPawns.popLsb()));
     }
     return seats;
 }
@@ -494,86 +543,28 @@ RowCol_pair_vector SeatManager::getPawnRowCols(bool isBottom)
     return rowcol_pv;
 }
 
-RowCol_pair_vector
+RowCol_pair_view
 SeatManager::getKingMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair)
 {
-    int frow{ rowcol_pair.first }, fcol{ rowcol_pair.second };
-    RowCol_pair_vector rowcol_pv{
-        { frow, fcol - 1 }, { frow, fcol + 1 },
-        { frow - 1, fcol }, { frow + 1, fcol }
-    };
-    int rowLow{ isBottom ? RowLowIndex_ : RowUpMidIndex_ },
-        rowUp{ isBottom ? RowLowMidIndex_ : RowUpIndex_ };
-    auto pos = remove_if(rowcol_pv.begin(), rowcol_pv.end(),
-        [&](const pair<int, int>& rowcol) {
-            return !(rowcol.first >= rowLow && rowcol.first <= rowUp
-                && rowcol.second >= ColMidLowIndex_ && rowcol.second <= ColMidUpIndex_);
-        });
-    return RowCol_pair_vector{ rowcol_pv.begin(), pos };
+    return __getTargetsView(kingTargets[__getTableIndex(isBottom, rowcol_pair)]);
 }
 
-RowCol_pair_vector
+RowCol_pair_view
 SeatManager::getAdvisorMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair)
 {
-    int frow{ rowcol_pair.first }, fcol{ rowcol_pair.second };
-    RowCol_pair_vector rowcol_pv{
-        { frow - 1, fcol - 1 }, { frow - 1, fcol + 1 },
-        { frow + 1, fcol - 1 }, { frow + 1, fcol + 1 }
-    };
-    int rowLow{ isBottom ? RowLowIndex_ : RowUpMidIndex_ },
-        rowUp{ isBottom ? RowLowMidIndex_ : RowUpIndex_ };
-    auto pos = remove_if(rowcol_pv.begin(), rowcol_pv.end(),
-        [&](const pair<int, int>& rowcol) {
-            return !(rowcol.first >= rowLow && rowcol.first <= rowUp
-                && rowcol.second >= ColMidLowIndex_ && rowcol.second <= ColMidUpIndex_);
-        });
-    return RowCol_pair_vector{ rowcol_pv.begin(), pos };
+    return __getTargetsView(advisorTargets[__getTableIndex(isBottom, rowcol_pair)]);
 }
 
-PRowCol_pair_vector
+PRowCol_pair_view
 SeatManager::getBishopObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair)
 {
-    int frow{ rowcol_pair.first }, fcol{ rowcol_pair.second };
-    PRowCol_pair_vector obs_MoveRowCols{
-        { { frow - 1, fcol - 1 }, { frow - 2, fcol - 2 } },
-        { { frow - 1, fcol + 1 }, { frow - 2, fcol + 2 } },
-        { { frow + 1, fcol - 1 }, { frow + 2, fcol - 2 } },
-        { { frow + 1, fcol + 1 }, { frow + 2, fcol + 2 } }
-    };
-    int rowLow{ isBottom ? RowLowIndex_ : RowUpLowIndex_ },
-        rowUp{ isBottom ? RowLowUpIndex_ : RowUpIndex_ };
-    auto pos = remove_if(obs_MoveRowCols.begin(), obs_MoveRowCols.end(),
-        [&](const PRowCol_pair& obs_Moverowcol) {
-            return (obs_Moverowcol.second.first < rowLow
-                || obs_Moverowcol.second.first > rowUp
-                || obs_Moverowcol.second.second < ColLowIndex_
-                || obs_Moverowcol.second.second > ColUpIndex_);
-        });
-    return PRowCol_pair_vector{ obs_MoveRowCols.begin(), pos };
+    return __getTargetsView(bishopTargets[__getTableIndex(isBottom, rowcol_pair)]);
 }
 
-PRowCol_pair_vector
+PRowCol_pair_view
 SeatManager::getKnightObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair)
 {
-    int frow{ rowcol_pair.first }, fcol{ rowcol_pair.second };
-    PRowCol_pair_vector obs_MoveRowCols{
-        { { frow - 1, fcol }, { frow - 2, fcol - 1 } },
-        { { frow - 1, fcol }, { frow - 2, fcol + 1 } },
-        { { frow, fcol - 1 }, { frow - 1, fcol - 2 } },
-        { { frow, fcol + 1 }, { frow - 1, fcol + 2 } },
-        { { frow, fcol - 1 }, { frow + 1, fcol - 2 } },
-        { { frow, fcol + 1 }, { frow + 1, fcol + 2 } },
-        { { frow + 1, fcol }, { frow + 2, fcol - 1 } },
-        { { frow + 1, fcol }, { frow + 2, fcol + 1 } }
-    };
-    auto pos = remove_if(obs_MoveRowCols.begin(), obs_MoveRowCols.end(),
-        [&](const PRowCol_pair& obs_Moverowcol) {
-            return (obs_Moverowcol.second.first < RowLowIndex_
-                || obs_Moverowcol.second.first > RowUpIndex_
-                || obs_Moverowcol.second.second < ColLowIndex_
-                || obs_Moverowcol.second.second > ColUpIndex_);
-        });
-    return PRowCol_pair_vector{ obs_MoveRowCols.begin(), pos };
+    return __getTargetsView(knightTargets[__getTableIndex(isBottom, rowcol_pair)]);
 }
 
 vector<RowCol_pair_vector>
@@ -592,22 +583,10 @@ SeatManager::getRookCannonMoveRowCol_Lines(const RowCol_pair& rowcol_pair)
     return rowcol_Lines;
 }
 
-RowCol_pair_vector
+RowCol_pair_view
 SeatManager::getPawnMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair)
 {
-    int frow{ rowcol_pair.first }, fcol{ rowcol_pair.second };
-    RowCol_pair_vector rowcol_pv{};
-    int row{}, col{};
-    if ((isBottom && (row = frow + 1) <= RowUpIndex_)
-        || (!isBottom && (row = frow - 1) >= RowLowIndex_))
-        rowcol_pv.emplace_back(row, fcol);
-    if (isBottom == (frow > RowLowUpIndex_)) { // 兵已过河
-        if ((col = fcol - 1) >= ColLowIndex_)
-            rowcol_pv.emplace_back(frow, col);
-        if ((col = fcol + 1) <= ColUpIndex_)
-            rowcol_pv.emplace_back(frow, col);
-    }
-    return rowcol_pv;
+    return __getTargetsView(pawnTargets[__getTableIndex(isBottom, rowcol_pair)]);
 }
 /* ===== Seats end. ===== */
 
@@ -1,46 +1,108 @@
 #ifndef SEAT_H
 #define SEAT_H
 
+#include "Bitboard.h"
 #include "ChessType.h"
+#include "Piece.h"
 
 namespace SeatSpace {
 
-// 棋子位置类
-class Seat : public enable_shared_from_this<Seat> {
+// 常量表的只读视图
+template <typename T>
+class TableView {
+public:
+    constexpr TableView(const T* first, int size)
+        : first_{ first }
+        , size_{ size }
+    {
+    }
+
+    const T* begin() const { return first_; }
+    const T* end() const { return first_ + size_; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& operator[](int index) const { return first_[index]; }
+
+private:
+    const T* first_;
+    int size_;
+};
+
+typedef TableView<RowCol_pair> RowCol_pair_view;
+typedef TableView<PRowCol_pair> PRowCol_pair_view;
 
+// 着法编码：起止位置的序号（行 * 9 + 列）各占7位
+class MoveCode {
 public:
-    explicit Seat(int row, int col);
+    constexpr MoveCode()
+        : code_{ 0 }
+    {
+    }
+    constexpr MoveCode(int findex, int tindex)
+        : code_{ static_cast<uint16_t>(findex << IndexBits_ | tindex) }
+    {
+    }
+    explicit MoveCode(const PRowCol_pair& prowcol_pair);
+    static constexpr MoveCode fromCode(int code) { return MoveCode{ code >> IndexBits_, code & IndexMask_ }; }
+
+    int findex() const { return code_ >> IndexBits_; }
+    int tindex() const { return code_ & IndexMask_; }
+    PRowCol_pair getPRowCol_pair() const;
+    bool isNull() const { return code_ == 0; } // 起止位置相同，非着法
+    uint16_t code() const { return code_; }
+
+    bool operator==(const MoveCode& moveCode) const { return code_ == moveCode.code_; }
+    bool operator!=(const MoveCode& moveCode) const { return code_ != moveCode.code_; }
 
-    int row() const { return row_; }
-    int col() const { return col_; }
-    RowCol_pair rowCol_pair() { return make_pair(row_, col_); }
-    const SPiece& piece() const { return piece_; }
+private:
+    static constexpr int IndexBits_{ 7 }, IndexMask_{ (1 << IndexBits_) - 1 };
 
-    bool isSameColor(const SSeat& seat) const;
-    void setPiece(const SPiece& piece = nullptr) const { piece_ = piece; }
-    const SPiece movTo(const SSeat& tseat, const SPiece& eatPiece = nullptr) const;
+    uint16_t code_;
+};
 
-    const wstring toString() const;
+// 着法列表：在栈上分配的定长数组
+class MoveList {
+public:
+    // 一方可走着法的上限：车炮每子17、马8、兵3、将士象4，合计119
+    static constexpr int Capacity{ 128 };
+
+    const MoveCode* begin() const { return moves_; }
+    const MoveCode* end() const { return moves_ + size_; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const MoveCode& operator[](int index) const { return moves_[index]; }
+
+    void clear() { size_ = 0; }
+    void push_back(MoveCode moveCode)
+    {
+        assert(size_ < Capacity);
+        moves_[size_++] = moveCode;
+    }
 
 private:
-    const int row_, col_;
-    mutable SPiece piece_{};
+    MoveCode moves_[Capacity];
+    int size_{ 0 };
 };
 
-// 棋盘位置类
+// 棋盘位置类：带边界填充的单字节棋子数组
 class Seats {
 public:
     Seats();
 
-    const SSeat& getSeat(int row, int col) const;
-    const SSeat& getSeat(RowCol_pair rowcol_pair) const;
+    Piece getPiece(Seat seat) const { return pieces_[seat]; }
+    Piece getPiece(int row, int col) const;
     PieceColor getSideColor(bool isBottom) const;
     bool isKilled(PieceColor bottomColor, PieceColor color) const;
     bool isDied(PieceColor bottomColor, PieceColor color) const;
+    // 棋子位置的Zobrist键值（不含走棋方）
+    uint64_t getHashKey() const { return bitboards_.getHashKey(); }
 
     // 棋子可放置的位置
-    RowCol_pair_vector getPutRowCols(PieceColor bottomColor, const SPiece& piece) const;
+    RowCol_pair_vector getPutRowCols(PieceColor bottomColor, Piece piece) const;
     RowCol_pair_vector getCanMoveRowCols(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const;
+    // 某方全部合法着法（一次计算牵制信息）
+    void generateLegalMoves(PieceColor bottomColor, PieceColor color, MoveList& moveList) const;
+    bool isCanMove(PieceColor bottomColor, MoveCode moveCode) const;
     // 取得棋盘上活的棋子
     RowCol_pair_vector getLiveRowCols(PieceColor color, wchar_t name = BLANKNAME,
         int col = BLANKCOL, bool getStronge = false) const;
@@ -48,36 +110,34 @@ public:
     PRowCol_pair getPRowCol_pair(PieceColor bottomColor, const wstring& str) const;
     const wstring getZHStr(PieceColor bottomColor, PRowCol_pair prowcol_pair) const;
 
-    const SPiece doneMove(PRowCol_pair prowcol_pair) const;
-    void undoMove(PRowCol_pair prowcol_pair, const SPiece& eatPie) const;
+    Piece doneMove(MoveCode moveCode);
+    void undoMove(MoveCode moveCode, Piece eatPie);
 
-    void setBoardPieces(const vector<SPiece>& boardPieces);
-    void changeSide(const ChangeType ct, const shared_ptr<PieceSpace::Pieces>& pieces);
+    void setBoardPieces(const wstring& pieceChars);
+    // FEN棋子布局字段（遇空格止）与棋盘数组直接转换，格式错误则抛出异常
+    void setFEN(const wstring& fen);
+    const wstring getFEN() const;
+    void changeSide(const ChangeType ct);
     const wstring getPieceChars() const;
     const wstring toString() const;
 
 private:
-    SSeat_vector allSeats_{};
+    Piece pieces_[SEATPADNUM];
+    Bitboards bitboards_{}; // 与pieces_同步更新，用于计算走法及试走
 
-    const SSeat& __getKingSeat(bool isBottom) const;
+    Seat __getKingSeat(bool isBottom) const;
+    Piece __movTo(Seat fseat, Seat tseat, Piece eatPiece = Piece{});
+    void __resetBitboards();
 
-    RowCol_pair_vector __getRowCols(const SSeat_vector& seats) const;
-    SSeat_vector __getSeats(const RowCol_pair_vector& rowcol_pv) const;
+    RowCol_pair_vector __getRowCols(const Seat_vector& seats) const;
 
-    // 排除同颜色棋子，fseat为空则无需排除
-    SSeat_vector __getMoveSeats(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const;
-    // 某位置棋子可移动的位置（未排除被将军的情况）
-    SSeat_vector __getCanMoveSeats(PieceColor bottomColor, const RowCol_pair& rowcol_pair) const;
+    // 某位置棋子可移动的位置（已排除被将军的情况）
+    Seat_vector __getCanMoveSeats(PieceColor bottomColor, Seat fseat) const;
     // 取得棋盘上活的棋子
-    SSeat_vector __getLiveSeats(PieceColor color, wchar_t name = BLANKNAME,
+    Seat_vector __getLiveSeats(PieceColor color, wchar_t name = BLANKNAME,
         int col = BLANKCOL, bool getStronge = false) const;
     // '多兵排序'
-    SSeat_vector __getSortPawnLiveSeats(bool isBottom, PieceColor color, wchar_t name) const;
-
-    RowCol_pair_vector __getNonObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair,
-        PRowCol_pair_vector (*getObs_MoveRowCols)(bool, const RowCol_pair&)) const;
-    SSeat_vector __getRook_MoveSeats(const SSeat& fseat) const;
-    SSeat_vector __getCannon_MoveSeats(const SSeat& fseat) const;
+    Seat_vector __getSortPawnLiveSeats(bool isBottom, PieceColor color, wchar_t name) const;
 };
 
 // 棋盘位置管理类
@@ -85,6 +145,20 @@ class SeatManager {
 public:
     static bool isBottom(int row) { return row < RowLowUpIndex_; };
     static int getIndex_rc(int row, int col) { return row * BOARDCOLNUM + col; }
+    // 带边界填充的棋盘数组：行、列各偏移3位，四个方向的步长为±1、±16
+    static constexpr Seat getSeat(int row, int col) { return ((row + SeatRowPad_) << 4) + col + SeatColPad_; }
+    static constexpr Seat getSeat(RowCol_pair rowcol_pair) { return getSeat(rowcol_pair.first, rowcol_pair.second); }
+    static constexpr int getSeatRow(Seat seat) { return (seat >> 4) - SeatRowPad_; }
+    static constexpr int getSeatCol(Seat seat) { return (seat & 0xF) - SeatColPad_; }
+    static RowCol_pair getSeatRowCol_pair(Seat seat) { return make_pair(getSeatRow(seat), getSeatCol(seat)); }
+    // 位棋盘序号与位置的转换
+    static int getIndex(Seat seat) { return getIndex_rc(getSeatRow(seat), getSeatCol(seat)); }
+    static Seat getSeatFromIndex(int index) { return getSeat(index / BOARDCOLNUM, index % BOARDCOLNUM); }
+    static constexpr bool isOnBoard(Seat seat)
+    {
+        return getSeatRow(seat) >= RowLowIndex_ && getSeatRow(seat) <= RowUpIndex_
+            && getSeatCol(seat) >= ColLowIndex_ && getSeatCol(seat) <= ColUpIndex_;
+    }
     static int getRowCol(int row, int col) { return row * 10 + col; }
     static int getRowCol(RowCol_pair rowcol_pair) { return getRowCol(rowcol_pair.first, rowcol_pair.second); }
     static RowCol_pair getRowCol_pair(int rowcol) { return make_pair(rowcol / 10, rowcol % 10); }
@@ -97,17 +171,26 @@ public:
     static RowCol_pair_vector getBishopRowCols(bool isBottom);
     static RowCol_pair_vector getPawnRowCols(bool isBottom);
 
-    static RowCol_pair_vector getKingMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
-    static RowCol_pair_vector getAdvisorMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
-    static PRowCol_pair_vector getBishopObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
-    static PRowCol_pair_vector getKnightObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
+    // 返回编译期走法表的视图
+    static RowCol_pair_view getKingMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
+    static RowCol_pair_view getAdvisorMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
+    static PRowCol_pair_view getBishopObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
+    static PRowCol_pair_view getKnightObs_MoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
     static vector<RowCol_pair_vector> getRookCannonMoveRowCol_Lines(const RowCol_pair& rowcol_pair);
-    static RowCol_pair_vector getPawnMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
+    static RowCol_pair_view getPawnMoveRowCols(bool isBottom, const RowCol_pair& rowcol_pair);
 
 private:
     static constexpr int RowLowIndex_{ 0 }, RowLowMidIndex_{ 2 }, RowLowUpIndex_{ 4 },
         RowUpLowIndex_{ 5 }, RowUpMidIndex_{ 7 }, RowUpIndex_{ 9 },
-        ColLowIndex_{ 0 }, ColMidLowIndex_{ 3 }, ColMidUpIndex_{ 5 }, ColUpIndex_{ 8 };
+        ColLowIndex_{ 0 }, ColMidLowIndex_{ 3 }, ColMidUpIndex_{ 5 }, ColUpIndex_{ 8 },
+        SeatRowPad_{ 3 }, SeatColPad_{ 3 };
+
+    static int __getTableIndex(bool isBottom, const RowCol_pair& rowcol_pair) { return isBottom * SEATNUM + getIndex_rc(rowcol_pair.first, rowcol_pair.second); }
+    template <typename Targets>
+    static auto __getTargetsView(const Targets& targets) -> TableView<typename remove_extent<decltype(targets.items)>::type>
+    {
+        return { targets.items, targets.size };
+    }
 };
 
 const wstring getRowColsStr(const RowCol_pair_vector& rowcols);
@@ -1,15 +1,22 @@
 ﻿#include "Tools.h"
+#include "GBKTable.h"
 
 #include <algorithm>
-#include <direct.h>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
-#include <io.h>
 #include <iostream>
 #include <sstream>
 
-using namespace std;
+#if defined(__SSE2__) || defined(_M_X64)
+#define TOOLS_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
-wstring_convert<codecvt_utf8<wchar_t>> wscvt;
+using namespace std;
 
 namespace Tools {
 
@@ -38,33 +45,310 @@ StrType trim(const StrType& str)
     return str.substr(first, last - first);
 }
 
-//string中的UTF-8字节流转换成UTF-16并保存在std::wstring中
-wstring s2ws(const string& s)
+#ifdef TOOLS_SSE2
+// 非零掩码的最低置位序号
+static int lowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index{};
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// 开头连续的ASCII字节数：按16字节（SSE2）或8字节一组检查最高位
+static size_t asciiLength(const unsigned char* s, size_t size)
+{
+    size_t i{ 0 };
+#ifdef TOOLS_SSE2
+    for (; i + 16 <= size; i += 16) {
+        int mask{ _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i))) };
+        if (mask)
+            return i + lowestBit(static_cast<unsigned>(mask));
+    }
+#endif
+    for (uint64_t word; i + 8 <= size; i += 8) {
+        memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ULL)
+            break;
+    }
+    while (i < size && s[i] < 0x80)
+        ++i;
+    return i;
+}
+
+// 写入一个码点，wchar_t为16位时超出BMP的码点使用代理对
+static wchar_t* putCode(wchar_t* out, char32_t code)
+{
+    if (sizeof(wchar_t) == 2 && code > 0xFFFF) {
+        code -= 0x10000;
+        *out++ = static_cast<wchar_t>(0xD800 | code >> 10);
+        *out++ = static_cast<wchar_t>(0xDC00 | (code & 0x3FF));
+    } else
+        *out++ = static_cast<wchar_t>(code);
+    return out;
+}
+
+// 解码一个非ASCII字符，返回使用的字节数；无效字节转为U+FFFD，只使用一个字节
+static size_t decodeUTF8(const unsigned char* s, size_t size, wchar_t*& out)
+{
+    unsigned char c{ s[0] };
+    size_t len{ c >= 0xF0 ? 4u : (c >= 0xE0 ? 3u : (c >= 0xC2 ? 2u : 0u)) };
+    char32_t code{ len == 4 ? c & 0x07u : (len == 3 ? c & 0x0Fu : c & 0x1Fu) };
+    bool isValid{ len > 0 && len <= size && c < 0xF5 };
+    for (size_t j = 1; isValid && j < len; ++j)
+        if ((s[j] & 0xC0) == 0x80)
+            code = code << 6 | (s[j] & 0x3F);
+        else
+            isValid = false;
+    if (!isValid) {
+        *out++ = static_cast<wchar_t>(0xFFFD);
+        return 1;
+    }
+    out = putCode(out, code);
+    return len;
+}
+
+static size_t decodeGBK(const unsigned char* s, size_t size, wchar_t*& out)
+{
+    unsigned char lead{ s[0] };
+    if (lead == 0x80) { // CP936单字节欧元符号
+        *out++ = static_cast<wchar_t>(0x20AC);
+        return 1;
+    }
+    if (lead == 0xFF || size < 2 || s[1] < GBKTrailFirst || s[1] >= GBKTrailFirst + GBKTrailNum) {
+        *out++ = static_cast<wchar_t>(0xFFFD);
+        return 1;
+    }
+    *out++ = static_cast<wchar_t>(GBKToUnicode[(lead - GBKLeadFirst) * GBKTrailNum + s[1] - GBKTrailFirst]);
+    return 2;
+}
+
+// Unicode（基本多文种平面）到GBK的反查表，首次使用时由对照表生成，0为无对应字符
+static const vector<uint16_t>& getUnicodeToGBK()
+{
+    static const vector<uint16_t> unicodeToGBK{ []() {
+        vector<uint16_t> table(0x10000, 0);
+        for (int lead = 0; lead != GBKLeadNum; ++lead)
+            for (int trail = 0; trail != GBKTrailNum; ++trail) {
+                uint16_t code{ GBKToUnicode[lead * GBKTrailNum + trail] };
+                if (code != 0xFFFD && table[code] == 0)
+                    table[code] = (GBKLeadFirst + lead) << 8 | (GBKTrailFirst + trail);
+            }
+        table[0x20AC] = 0x80;
+        return table;
+    }() };
+    return unicodeToGBK;
+}
+
+// 结果的长度不超过预留的上限：每字节至多一个宽字符，每个宽字符至多4字节
+size_t decode(const char* str, size_t size, Charset charset, wstring& ws)
+{
+    const unsigned char* s{ reinterpret_cast<const unsigned char*>(str) };
+    size_t oldSize{ ws.size() }, invalidNum{ 0 };
+    ws.resize(oldSize + size);
+    wchar_t* out{ &ws[0] + oldSize };
+    for (size_t i = 0; i < size;) {
+        if (s[i] < 0x80) {
+            size_t len{ asciiLength(s + i, size - i) };
+            out = copy(s + i, s + i + len, out);
+            i += len;
+            continue;
+        }
+        if (charset == Charset::UTF8 && (s[i] & 0xF0) == 0xE0 && size - i >= 3
+            && (s[i + 1] & 0xC0) == 0x80 && (s[i + 2] & 0xC0) == 0x80) { // 三字节序列（含全部常用汉字）
+            *out++ = static_cast<wchar_t>((s[i] & 0x0F) << 12 | (s[i + 1] & 0x3F) << 6 | (s[i + 2] & 0x3F));
+            i += 3;
+            continue;
+        }
+        i += charset == Charset::GBK ? decodeGBK(s + i, size - i, out) : decodeUTF8(s + i, size - i, out);
+        invalidNum += out[-1] == static_cast<wchar_t>(0xFFFD);
+    }
+    ws.resize(out - ws.data());
+    return invalidNum;
+}
+
+void encode(const wchar_t* wstr, size_t size, Charset charset, string& s)
+{
+    size_t oldSize{ s.size() };
+    s.resize(oldSize + size * (charset == Charset::GBK ? 2 : 4));
+    char* out{ &s[0] + oldSize };
+    const vector<uint16_t>* unicodeToGBK{ charset == Charset::GBK ? &getUnicodeToGBK() : nullptr };
+    for (size_t i = 0; i < size; ++i) {
+        char32_t code{ static_cast<char32_t>(wstr[i]) };
+        if (code < 0x80) {
+            *out++ = static_cast<char>(code);
+            continue;
+        }
+        if (sizeof(wchar_t) == 2 && code >= 0xD800 && code < 0xDC00 && i + 1 < size) {
+            char32_t low{ static_cast<char32_t>(wstr[i + 1]) };
+            if (low >= 0xDC00 && low < 0xE000) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+        if (unicodeToGBK) {
+            uint16_t gbk{ code < 0x10000 ? (*unicodeToGBK)[code] : uint16_t{ 0 } };
+            if (gbk == 0)
+                *out++ = '?';
+            else if (gbk < 0x100)
+                *out++ = static_cast<char>(gbk);
+            else {
+                *out++ = static_cast<char>(gbk >> 8);
+                *out++ = static_cast<char>(gbk & 0xFF);
+            }
+        } else if (code < 0x800) {
+            *out++ = static_cast<char>(0xC0 | code >> 6);
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            *out++ = static_cast<char>(0xE0 | code >> 12);
+            *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            *out++ = static_cast<char>(0xF0 | code >> 18);
+            *out++ = static_cast<char>(0x80 | (code >> 12 & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    s.resize(out - s.data());
+}
+
+bool isUTF8(const char* str, size_t size)
+{
+    const unsigned char* s{ reinterpret_cast<const unsigned char*>(str) };
+    for (size_t i = 0; i < size;) {
+        if (s[i] < 0x80) {
+            i += asciiLength(s + i, size - i);
+            continue;
+        }
+        unsigned char c{ s[i] };
+        size_t len{ c >= 0xF0 ? 4u : (c >= 0xE0 ? 3u : (c >= 0xC2 ? 2u : 0u)) };
+        if (len == 0 || c >= 0xF5 || len > size - i)
+            return false;
+        for (size_t j = 1; j < len; ++j)
+            if ((s[i + j] & 0xC0) != 0x80)
+                return false;
+        i += len;
+    }
+    return true;
+}
+
+Charset detectCharset(const char* str, size_t size)
 {
-    const char* str = s.c_str();
-    size_t len = s.size() + 1;
-    wchar_t* wstr = new wchar_t[len];
-    mbstowcs(wstr, str, len);
-    wstring ret(wstr);
-    delete[] wstr;
-    return ret;
+    return isUTF8(str, size) ? Charset::UTF8 : Charset::GBK;
+}
+
+// 先按UTF-8解码，出现无效字节再按GBK重新解码，有效的UTF-8文本只需扫描一遍；
+// 与文本方式读取一致，"\r\n"转为"\n"
+wstring decodeText(const string& bytes)
+{
+    wstring ws{};
+    size_t bom{ bytes.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3u : 0u };
+    if (decode(bytes.data() + bom, bytes.size() - bom, Charset::UTF8, ws) > 0 && !bom) {
+        ws.clear();
+        decode(bytes.data(), bytes.size(), Charset::GBK, ws);
+    }
+    size_t out{ ws.find(L'\r') };
+    if (out != wstring::npos) {
+        for (size_t in = out; in != ws.size(); ++in)
+            if (ws[in] != L'\r' || in + 1 == ws.size() || ws[in + 1] != L'\n')
+                ws[out++] = ws[in];
+        ws.resize(out);
+    }
+    return ws;
 }
 
-//wstring转换到std::string
-string ws2s(const wstring& ws)
+EncodeStreambuf::EncodeStreambuf(ostream& os, Charset charset, bool crlf)
+    : os_{ os }
+    , charset_{ charset }
+    , crlf_{ crlf }
 {
-    const wchar_t* wstr = ws.c_str();
-    size_t len = 2 * ws.size() + 1;
-    char* str = new char[len];
-    wcstombs(str, wstr, len);
-    string ret(str);
-    delete[] str;
-    return ret;
+    setp(buffer_, buffer_ + BufferSize_);
+}
+
+EncodeStreambuf::~EncodeStreambuf() { __flush(true); }
+
+EncodeStreambuf::int_type EncodeStreambuf::overflow(int_type ch)
+{
+    __flush(false);
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int EncodeStreambuf::sync()
+{
+    __flush(false);
+    return os_.good() ? 0 : -1;
+}
+
+// 块末尾的高位代理留待与下一块的低位代理一起编码
+void EncodeStreambuf::__flush(bool isEnd)
+{
+    size_t size{ static_cast<size_t>(pptr() - pbase()) };
+    bool keepLast{ !isEnd && sizeof(wchar_t) == 2 && size > 0 && buffer_[size - 1] >= 0xD800 && buffer_[size - 1] < 0xDC00 };
+    bytes_.clear();
+    encode(buffer_, size - keepLast, charset_, bytes_);
+    if (crlf_ && bytes_.find('\n') != string::npos) { // UTF-8、GBK的多字节字符中均无'\n'
+        crlfBytes_.clear();
+        for (char ch : bytes_) {
+            if (ch == '\n')
+                crlfBytes_ += '\r';
+            crlfBytes_ += ch;
+        }
+        bytes_.swap(crlfBytes_);
+    }
+    os_.write(bytes_.data(), bytes_.size());
+    if (keepLast)
+        buffer_[0] = buffer_[size - 1];
+    setp(buffer_, buffer_ + BufferSize_);
+    pbump(keepLast);
+}
+
+wstring utf82ws(const char* str, size_t size)
+{
+    wstring ws{};
+    decode(str, size, Charset::UTF8, ws);
+    return ws;
+}
+
+wstring utf82ws(const string& s) { return utf82ws(s.data(), s.size()); }
+
+string ws2utf8(const wstring& ws)
+{
+    string s{};
+    encode(ws.data(), ws.size(), Charset::UTF8, s);
+    return s;
+}
+
+wstring gbk2ws(const char* str, size_t size)
+{
+    wstring ws{};
+    decode(str, size, Charset::GBK, ws);
+    return ws;
+}
+
+wstring gbk2ws(const string& s) { return gbk2ws(s.data(), s.size()); }
+
+string ws2gbk(const wstring& ws)
+{
+    string s{};
+    encode(ws.data(), ws.size(), Charset::GBK, s);
+    return s;
 }
 
 const string getExtStr(const string& filename)
 {
-    string ext{ filename.substr(filename.rfind('.')) };
+    size_t dot{ filename.rfind('.') };
+    if (dot == string::npos || filename.find_first_of("/\\", dot) != string::npos)
+        return string{}; // 无扩展名
+    string ext{ filename.substr(dot) };
     for (auto& c : ext)
         c = tolower(c);
     return ext;
@@ -79,35 +363,26 @@ const wstring getWString(wistream& wis)
 
 wstring readFile(const string& fileName)
 {
-    wifstream wifs(fileName);
-    wstring wstr = getWString(wifs);
-    wifs.close();
-    return wstr;
+    ifstream ifs(fileName, ios_base::binary);
+    stringstream ss{};
+    ss << ifs.rdbuf();
+    return decodeText(ss.str());
 }
 
 void writeFile(const string& fileName, const wstring& wstr)
 {
-    wofstream wofs(fileName);
-    if (wofs)
-        wofs << wstr << flush;
-    wofs.close();
+    ofstream ofs(fileName, ios_base::binary);
+    string bytes{ ws2utf8(wstr) };
+    if (ofs)
+        ofs.write(bytes.data(), bytes.size()) << flush;
+    ofs.close();
 }
 
 void getFiles(const string& path, vector<string>& files)
 {
-    long hFile = 0; //文件句柄
-    struct _finddata_t fileinfo; //文件信息
-    string p{};
-    if ((hFile = _findfirst(p.assign(path).append("\\*").c_str(), &fileinfo)) != -1) {
-        do { //如果是目录,迭代之  //如果不是,加入列表
-            if (fileinfo.attrib & _A_SUBDIR) {
-                if (strcmp(fileinfo.name, ".") != 0 && strcmp(fileinfo.name, "..") != 0)
-                    getFiles(p.assign(path).append("\\").append(fileinfo.name), files);
-            } else
-                files.push_back(p.assign(path).append("\\").append(fileinfo.name));
-        } while (_findnext(hFile, &fileinfo) == 0);
-        _findclose(hFile);
-    }
+    for (auto& entry : filesystem::recursive_directory_iterator{ path }) //如果是目录,迭代之  //如果不是,加入列表
+        if (!entry.is_directory())
+            files.push_back(entry.path().string());
 }
 
 /*****************************************************************************************
@@ -2,23 +2,59 @@
 #ifndef TOOLS_H
 #define TOOLS_H
 
-#include <codecvt>
-#include <locale>
 #include <map>
+#include <ostream>
 #include <string>
 #include <vector>
 
 using namespace std;
 
-extern wstring_convert<codecvt_utf8<wchar_t>> wscvt;
-
 namespace Tools {
 
 template <typename StrType>
 StrType trim(const StrType& str);
 
-std::wstring s2ws(const std::string& s);
-std::string ws2s(const std::wstring& ws);
+// 编码转换：内置GBK对照表，与区域设置无关，可多线程调用；
+// decode/encode将结果追加到调用者的缓冲区，成段的ASCII字符直接复制；wchar_t为16位时使用代理对
+enum class Charset {
+    UTF8,
+    GBK
+};
+size_t decode(const char* str, size_t size, Charset charset, std::wstring& ws); // 返回无法解码的字符数（已转为U+FFFD）
+void encode(const wchar_t* wstr, size_t size, Charset charset, std::string& s);
+bool isUTF8(const char* str, size_t size);
+Charset detectCharset(const char* str, size_t size); // 有效的UTF-8视为UTF-8，否则为GBK
+std::wstring decodeText(const std::string& bytes); // 文本文件：有BOM或有效的UTF-8按UTF-8，否则按GBK；"\r\n"转为"\n"
+
+// 宽字符输出流的缓冲区：按块编码后写入字节流，不依赖流的区域设置；
+// crlf时"\n"写为"\r\n"（与文本方式写入一致，decodeText读取时转回）
+class EncodeStreambuf : public std::wstreambuf {
+public:
+    EncodeStreambuf(std::ostream& os, Charset charset, bool crlf = false);
+    ~EncodeStreambuf() override;
+
+protected:
+    int_type overflow(int_type ch) override;
+    int sync() override;
+
+private:
+    static constexpr int BufferSize_{ 4096 };
+
+    std::ostream& os_;
+    Charset charset_;
+    bool crlf_;
+    wchar_t buffer_[BufferSize_];
+    std::string bytes_, crlfBytes_;
+
+    void __flush(bool isEnd);
+};
+
+std::wstring utf82ws(const char* str, size_t size);
+std::wstring utf82ws(const std::string& s);
+std::string ws2utf8(const std::wstring& ws);
+std::wstring gbk2ws(const char* str, size_t size);
+std::wstring gbk2ws(const std::string& s);
+std::string ws2gbk(const std::wstring& ws);
 
 const std::string getExtStr(const std::string& filename);
 
@@ -17,6 +17,18 @@ int main(int argc, char const* argv[])
 
     auto time0 = steady_clock::now();
 
+    // 走法生成测试：perft 层数 [FEN r|b [线程数]]，无FEN时校验参考局面
+    if (argc > 2 && string{ argv[1] } == "perft") {
+        int depth{ std::stoi(argv[2]) };
+        if (argc > 3) {
+            string fen{ argv[3] };
+            PieceColor color{ argc > 4 && string{ argv[4] } == "b" ? PieceColor::BLACK : PieceColor::RED };
+            wcout << perftDivide(wstring{ fen.begin(), fen.end() }, color, depth, argc > 5 ? std::stoi(argv[5]) : 0);
+        } else
+            wcout << testPerft(depth);
+        return 0;
+    }
+
     /*
     string fname = "a.txt";
     wofstream wofs(fname);